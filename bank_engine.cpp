@@ -0,0 +1,2452 @@
+#include <iostream>
+#include <pthread.h>
+#include <vector>
+#include <cstdlib>
+#include <unistd.h>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+#include <cstdint>
+#include <cmath>
+#include <new>
+#include <climits>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <atomic>
+#include <sched.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#include "bank_simulator.h"
+
+using namespace std;
+
+// Function to convert a dollar amount (user input) to Money
+Money toMoney(double dollars) {
+    return llround(dollars * CENTS_PER_DOLLAR);
+}
+
+// Function to format Money as dollars and cents, e.g. -1234 -> "-12.34"
+string formatMoney(Money value) {
+    char buffer[32];
+    unsigned long long magnitude = value < 0 ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+    snprintf(buffer, sizeof(buffer), "%s%llu.%02llu", value < 0 ? "-" : "",
+             magnitude / CENTS_PER_DOLLAR, magnitude % CENTS_PER_DOLLAR);
+    return buffer;
+}
+
+// Function to allocate a cache-line-aligned, zeroed array
+char* allocateAligned(size_t bytes) {
+    bytes = (bytes + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+    char* memory = (char*)aligned_alloc(CACHE_LINE_SIZE, bytes);
+    if (memory != nullptr) memset(memory, 0, bytes);
+    return memory;
+}
+
+// Function to scramble a slot's sequence number into a sparse account number. The
+// splitmix64 finalizer is a bijection, so distinct inputs (>= 1) give distinct, non-zero numbers.
+uint64_t sparseAccountNumber(uint64_t sequence) {
+    uint64_t z = sequence;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Function to size an index for count accounts; returns false if the allocation fails
+bool initAccountIndex(AccountIndex& index, size_t count) {
+    uint64_t capacity = 16;
+    int bits = 4;
+    while (capacity < count + count / 2) {
+        capacity <<= 1;
+        bits++;
+    }
+    index.entries = (AccountIndexEntry*)allocateAligned(capacity * sizeof(AccountIndexEntry));
+    if (index.entries == nullptr) return false;
+    for (uint64_t i = 0; i < capacity; i++) index.entries[i].slot.store(-1, memory_order_relaxed);
+    index.mask = capacity - 1;
+    index.shift = 64 - bits;
+    return true;
+}
+
+// Function to release an index
+void destroyAccountIndex(AccountIndex& index) {
+    free(index.entries);
+    index = AccountIndex();
+}
+
+// Function to round a field size up to the stride used by the chosen layout
+size_t layoutStride(size_t fieldSize, AccountLayout layout) {
+    if (layout == LAYOUT_PACKED) return fieldSize;
+    return (fieldSize + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+}
+
+static_assert(sizeof(atomic<Money>) == sizeof(Money), "atomic<Money> must be a plain 64-bit word");
+
+// Function to create all accounts in place; locks are initialized where they will live
+bool initAccountStore(AccountStore& store, int count, Money initialBalance, AccountLayout layout,
+                      AccountNumbering numbering, LockPolicy lockPolicy) {
+    store.count = count;
+    store.layout = layout;
+    store.lockPolicy = lockPolicy;
+    store.balanceStride = layoutStride(sizeof(atomic<Money>), layout);
+    store.lockStride = layoutStride(lockPolicy == LOCK_MUTEX ? sizeof(pthread_mutex_t) : sizeof(atomic<uint32_t>),
+                                    layout);
+    store.balanceBase = allocateAligned(count * store.balanceStride);
+    store.lockBase = allocateAligned(count * store.lockStride);
+    store.accountNumbers = new uint64_t[count];
+    store.historyHeads = new atomic<TxnRef>[count];
+    store.contention = new AccountContention[count];
+    if (store.balanceBase == nullptr || store.lockBase == nullptr || 
+        !initAccountIndex(store.numberIndex, count)) return false;
+    
+    for (int i = 0; i < count; i++) {
+        store.accountNumbers[i] = (numbering == ACCOUNT_NUMBERS_SPARSE) ? sparseAccountNumber(i + 1) : i + 1;
+        store.numberIndex.insert(store.accountNumbers[i], i);
+        new (&store.balance(i)) atomic<Money>(initialBalance);
+        store.historyHeads[i].store(NO_TXN, memory_order_relaxed);
+        store.contention[i].blocked.store(0, memory_order_relaxed);
+        store.contention[i].waitNanos.store(0, memory_order_relaxed);
+        if (lockPolicy == LOCK_MUTEX) pthread_mutex_init(store.lock(i), nullptr);
+        else new (&store.lockWord(i)) atomic<uint32_t>(0);
+    }
+    return true;
+}
+
+// Function to give every account a version word (even = unlocked), for optimistic concurrency
+bool initAccountVersions(AccountStore& store) {
+    if (store.versionBase == nullptr) store.versionBase = allocateAligned(store.count * store.balanceStride);
+    if (store.versionBase == nullptr) return false;
+    for (int i = 0; i < store.count; i++) new (&store.version(i)) atomic<uint64_t>(0);
+    return true;
+}
+
+// Function to destroy the locks and release the store
+void destroyAccountStore(AccountStore& store) {
+    for (int i = 0; i < store.count && store.lockPolicy == LOCK_MUTEX; i++) {
+        pthread_mutex_destroy(store.lock(i));
+    }
+    free(store.balanceBase);
+    free(store.lockBase);
+    free(store.versionBase);
+    delete[] store.accountNumbers;
+    destroyAccountIndex(store.numberIndex);
+    delete[] store.historyHeads;
+    delete[] store.contention;
+    store = AccountStore();
+}
+
+// ---------------------------------------------------------------------------
+// Transaction history
+//
+// Each thread allocates Transaction records from its own arena of fixed-size
+// slabs, so recording history never allocates per record and never takes a
+// lock. Records of one account are chained newest-first through
+// Transaction::previous; the chain head is swapped in with one atomic
+// exchange. A TxnRef packs arena id, slab number and slot.
+// ---------------------------------------------------------------------------
+
+const int TXN_SLOT_BITS = 16;
+const int TXN_SLAB_BITS = 24;
+const uint64_t TXN_SLAB_RECORDS = 1ULL << TXN_SLOT_BITS;
+
+struct TransactionArena {
+    uint32_t id;
+    vector<Transaction*> slabs;
+    uint64_t used;              // records used in the last slab
+    
+    TransactionArena() : id(0), used(TXN_SLAB_RECORDS) {}
+};
+
+TransactionHistory history = { false, PTHREAD_MUTEX_INITIALIZER, {}, 0 };
+thread_local TransactionArena* threadArena = nullptr;
+thread_local uint64_t threadArenaGeneration = 0;
+
+// Function to find (or create) the calling thread's arena
+TransactionArena* getTransactionArena() {
+    if (threadArena == nullptr || threadArenaGeneration != history.generation) {
+        threadArena = new TransactionArena();
+        threadArenaGeneration = history.generation;
+        pthread_mutex_lock(&history.registryMutex);
+        threadArena->id = (uint32_t)history.arenas.size();
+        history.arenas.push_back(threadArena);
+        pthread_mutex_unlock(&history.registryMutex);
+    }
+    return threadArena;
+}
+
+// Function to resolve a TxnRef (valid once the writing thread has published it)
+const Transaction& getTransaction(TxnRef ref) {
+    uint64_t slot = ref & (TXN_SLAB_RECORDS - 1);
+    uint64_t slab = (ref >> TXN_SLOT_BITS) & ((1ULL << TXN_SLAB_BITS) - 1);
+    uint64_t arena = ref >> (TXN_SLOT_BITS + TXN_SLAB_BITS);
+    return history.arenas[arena]->slabs[slab][slot];
+}
+
+// Function to append a transaction to an account's history (hot path)
+void recordHistory(AccountStore& store, int accountIndex, int clientId, OpType op,
+                   Money amount, Money balanceAfter, uint64_t timestamp) {
+    TransactionArena* arena = getTransactionArena();
+    if (arena->used == TXN_SLAB_RECORDS) {
+        arena->slabs.push_back((Transaction*)allocateAligned(TXN_SLAB_RECORDS * sizeof(Transaction)));
+        arena->used = 0;
+    }
+    
+    uint64_t slab = arena->slabs.size() - 1;
+    uint64_t slot = arena->used++;
+    TxnRef ref = ((uint64_t)arena->id << (TXN_SLOT_BITS + TXN_SLAB_BITS)) 
+               | (slab << TXN_SLOT_BITS) | slot;
+    
+    Transaction& trans = arena->slabs[slab][slot];
+    trans.timestamp = timestamp;
+    trans.amount = amount;
+    trans.balanceAfter = balanceAfter;
+    trans.clientId = clientId;
+    trans.op = (uint8_t)op;
+    trans.previous = store.historyHead(accountIndex).exchange(ref, memory_order_acq_rel);
+}
+
+// Function to report arena usage: records stored and bytes reserved for them
+void getHistoryUsage(uint64_t& records, uint64_t& bytes) {
+    records = 0;
+    bytes = 0;
+    for (TransactionArena* arena : history.arenas) {
+        if (arena->slabs.empty()) continue;
+        records += (arena->slabs.size() - 1) * TXN_SLAB_RECORDS + arena->used;
+        bytes += arena->slabs.size() * TXN_SLAB_RECORDS * sizeof(Transaction);
+    }
+}
+
+// Function to release every arena (call after all threads have finished)
+void clearHistory() {
+    for (TransactionArena* arena : history.arenas) {
+        for (Transaction* slab : arena->slabs) free(slab);
+        delete arena;
+    }
+    history.arenas.clear();
+    history.generation++;
+}
+
+// ---------------------------------------------------------------------------
+// Reconciliation: one pass over every balance that totals them, counts
+// negative balances and tracks the minimum. The AVX2 kernel handles four
+// balances per instruction (contiguous loads for the packed layout, gathers
+// for the padded one); the scalar kernel is used when AVX2 is unavailable.
+// ---------------------------------------------------------------------------
+
+// Function to reconcile balances one at a time
+void reconcileScalar(const char* base, size_t stride, int begin, int end, Reconciliation& result) {
+    for (int i = begin; i < end; i++) {
+        Money balance = *(const Money*)(base + i * stride);
+        result.total += balance;
+        if (balance < 0) result.negativeCount++;
+        if (balance < result.minBalance) result.minBalance = balance;
+    }
+}
+
+#if defined(__x86_64__)
+// Function to reconcile balances four at a time; returns the first index not processed
+__attribute__((target("avx2")))
+int reconcileAvx2(const char* base, size_t stride, int count, Reconciliation& result) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i step = _mm256_set1_epi64x((long long)(4 * stride));
+    __m256i offsets = _mm256_set_epi64x((long long)(3 * stride), (long long)(2 * stride), 
+                                        (long long)stride, 0);
+    __m256i total = zero;
+    __m256i negatives = zero;
+    __m256i minimum = _mm256_set1_epi64x(result.minBalance);
+    bool contiguous = (stride == sizeof(Money));
+    
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256i balances = contiguous 
+            ? _mm256_loadu_si256((const __m256i*)(base + i * stride))
+            : _mm256_i64gather_epi64((const long long*)base, offsets, 1);
+        offsets = _mm256_add_epi64(offsets, step);
+        
+        total = _mm256_add_epi64(total, balances);
+        negatives = _mm256_sub_epi64(negatives, _mm256_cmpgt_epi64(zero, balances));
+        minimum = _mm256_blendv_epi8(minimum, balances, _mm256_cmpgt_epi64(minimum, balances));
+    }
+    
+    alignas(32) long long lanes[3][4];
+    _mm256_store_si256((__m256i*)lanes[0], total);
+    _mm256_store_si256((__m256i*)lanes[1], negatives);
+    _mm256_store_si256((__m256i*)lanes[2], minimum);
+    for (int lane = 0; lane < 4; lane++) {
+        result.total += lanes[0][lane];
+        result.negativeCount += lanes[1][lane];
+        result.minBalance = min(result.minBalance, (Money)lanes[2][lane]);
+    }
+    return i;
+}
+#endif
+
+// Function to reconcile every balance in the store (call when no transaction is in flight)
+Reconciliation reconcileBalances(const AccountStore& store) {
+    Reconciliation result;
+    result.total = 0;
+    result.minBalance = numeric_limits<Money>::max();
+    result.negativeCount = 0;
+    result.kernel = "scalar";
+    
+    int done = 0;
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2")) {
+        done = reconcileAvx2(store.balanceBase, store.balanceStride, store.count, result);
+        result.kernel = "avx2";
+    }
+#endif
+    reconcileScalar(store.balanceBase, store.balanceStride, done, store.count, result);
+    return result;
+}
+
+// Global variables
+AccountStore accounts;
+Config config;
+long long totalTransactionsCompleted = 0;
+
+// Monotonic clock in nanoseconds, used for benchmark timing
+uint64_t nowNanos() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// ---------------------------------------------------------------------------
+// Transaction journal
+//
+// Client threads never print. Each thread appends compact binary records to its
+// own single-producer/single-consumer ring buffer; a background writer thread
+// drains all rings, formats the records in batches and issues one write per batch.
+// ---------------------------------------------------------------------------
+
+// Per-thread ring buffer; head and tail live on separate cache lines
+struct JournalRing {
+    alignas(64) atomic<uint64_t> head;   // next slot to read (writer thread)
+    alignas(64) atomic<uint64_t> tail;   // next slot to write (owning thread)
+    uint64_t cachedHead;                 // producer's last view of head
+    uint64_t dropped;                    // records discarded under JOURNAL_DROP
+    uint64_t mask;
+    JournalRecord* slots;
+    
+    explicit JournalRing(uint64_t capacity) 
+        : head(0), tail(0), cachedHead(0), dropped(0), mask(capacity - 1),
+          slots(new JournalRecord[capacity]) {}
+    ~JournalRing() { delete[] slots; }
+};
+
+Journal journal;
+thread_local JournalRing* threadJournalRing = nullptr;
+thread_local uint64_t threadJournalGeneration = 0;
+
+// Function to find (or create) the calling thread's ring
+JournalRing* getJournalRing() {
+    if (threadJournalRing == nullptr || threadJournalGeneration != journal.generation) {
+        threadJournalRing = new JournalRing(journal.ringCapacity);
+        threadJournalGeneration = journal.generation;
+        pthread_mutex_lock(&journal.registryMutex);
+        journal.rings.push_back(threadJournalRing);
+        pthread_mutex_unlock(&journal.registryMutex);
+    }
+    return threadJournalRing;
+}
+
+// Function to append a record to the calling thread's ring (hot path)
+void journalAppend(const JournalRecord& record) {
+    JournalRing* ring = getJournalRing();
+    uint64_t tail = ring->tail.load(memory_order_relaxed);
+    
+    if (tail - ring->cachedHead > ring->mask) {
+        ring->cachedHead = ring->head.load(memory_order_acquire);
+        while (tail - ring->cachedHead > ring->mask) {
+            if (journal.policy == JOURNAL_DROP) {
+                ring->dropped++;
+                return;
+            }
+            sched_yield();
+            ring->cachedHead = ring->head.load(memory_order_acquire);
+        }
+    }
+    
+    ring->slots[tail & ring->mask] = record;
+    ring->tail.store(tail + 1, memory_order_release);
+}
+
+// Function to format one record as a log line
+void formatJournalRecord(ostringstream& line, const JournalRecord& rec, long long progress) {
+    time_t seconds = (time_t)(rec.timestamp / 1000000000ULL);
+    tm localTime;
+    localtime_r(&seconds, &localTime);
+    uint64_t accountNumber = accounts.accountNumber(rec.accountIndex);
+    
+    if (journal.format == JOURNAL_CSV) {
+        line << rec.clientId << ',' << OP_NAMES[rec.op] << ',' << accountNumber << ',';
+        if (rec.op == OP_TRANSFER) line << accounts.accountNumber(rec.toAccountIndex);
+        line << ',' << formatMoney(rec.amount) << ',' << rec.timestamp << '\n';
+        return;
+    }
+    if (journal.format != JOURNAL_TEXT_COLOR) {
+        line << put_time(&localTime, "%H:%M:%S") << '.' << setfill('0') << setw(9) 
+             << (rec.timestamp % 1000000000ULL) << setfill(' ')
+             << " client=" << rec.clientId << " op=" << OP_NAMES[rec.op]
+             << " status=" << OUTCOME_NAMES[rec.outcome]
+             << " account=" << accountNumber;
+        if (rec.op == OP_TRANSFER) line << " to=" << accounts.accountNumber(rec.toAccountIndex);
+        line << " amount=" << formatMoney(rec.amount)
+             << " balance=" << formatMoney(rec.balanceAfter);
+        if (rec.op == OP_TRANSFER && rec.success) line << " to_balance=" << formatMoney(rec.toBalanceAfter);
+        line << '\n';
+        return;
+    }
+    
+    line << Colors::DIM << "[" << put_time(&localTime, "%H:%M:%S") << "]" << Colors::RESET << " ";
+    
+    if (rec.outcome == OUTCOME_REFUSED) {
+        line << Colors::BRIGHT_CYAN << "Client " << rec.clientId << Colors::RESET << " | "
+             << Colors::RED << "⛔ REFUSED" << Colors::RESET
+             << " | " << OP_NAMES[rec.op] << " of $" << formatMoney(rec.amount)
+             << " | Write-ahead log full" << '\n';
+    } else if (!rec.success && rec.op == OP_WITHDRAW) {
+        line << Colors::BRIGHT_CYAN << "Client " << rec.clientId << Colors::RESET << " | "
+             << Colors::RED << "⚠️  INSUFFICIENT FUNDS" << Colors::RESET
+             << " | Attempted: $" << Colors::BOLD << formatMoney(rec.amount) << Colors::RESET
+             << " | " << Colors::MAGENTA << "Account " << accountNumber << Colors::RESET
+             << " | " << Colors::YELLOW << "Current Balance: $" 
+             << formatMoney(rec.balanceAfter) << Colors::RESET << '\n';
+    } else if (!rec.success) {
+        line << Colors::BRIGHT_CYAN << "Client " << rec.clientId << Colors::RESET << " | "
+             << Colors::RED << "❌ TRANSFER FAILED" << Colors::RESET
+             << " | Insufficient funds in " << Colors::MAGENTA << "Account " 
+             << accountNumber << Colors::RESET << '\n';
+    } else if (rec.op == OP_TRANSFER) {
+        line << Colors::BRIGHT_CYAN << "Client " << rec.clientId << Colors::RESET << " | "
+             << Colors::BLUE << "🔄 TRANSFER" << Colors::RESET
+             << " $" << Colors::BOLD << formatMoney(rec.amount) << Colors::RESET
+             << " | " << Colors::MAGENTA << "Account " << accountNumber 
+             << Colors::RESET << " → " << Colors::MAGENTA << "Account " 
+             << accounts.accountNumber(rec.toAccountIndex) << Colors::RESET
+             << " | From: $" << formatMoney(rec.balanceAfter)
+             << " | To: $" << formatMoney(rec.toBalanceAfter)
+             << " [" << Colors::BRIGHT_YELLOW << progress << "%" << Colors::RESET << "]" << '\n';
+    } else {
+        bool isDeposit = (rec.op == OP_DEPOSIT);
+        line << Colors::BRIGHT_CYAN << "Client " << setw(2) << rec.clientId << Colors::RESET << " | "
+             << (isDeposit ? Colors::GREEN : Colors::YELLOW) << (isDeposit ? "💰" : "💸") << " " 
+             << (isDeposit ? "DEPOSIT  " : "WITHDRAW ") << Colors::RESET
+             << " $" << Colors::BOLD << setw(10) << formatMoney(rec.amount) << Colors::RESET
+             << " | " << Colors::MAGENTA << "Account " << accountNumber << Colors::RESET
+             << " | " << Colors::BRIGHT_GREEN << "Balance: $" << setw(12) 
+             << formatMoney(rec.balanceAfter) << Colors::RESET
+             << " [" << Colors::BRIGHT_YELLOW << progress << "%" << Colors::RESET << "]" << '\n';
+    }
+}
+
+// Function to consume one record: ledger, progress and formatting
+void processJournalRecord(const JournalRecord& rec, ostringstream& text, string& binary) {
+    if (rec.success) totalTransactionsCompleted++;
+    if (rec.success && rec.op == OP_DEPOSIT) journal.deposited += rec.amount;
+    if (rec.success && rec.op == OP_WITHDRAW) journal.withdrawn += rec.amount;
+    
+    if (journal.format == JOURNAL_BINARY) {
+        binary.append((const char*)&rec, sizeof(rec));
+    } else {
+        // Only the interactive log shows progress; headless --duration runs have no fixed total
+        long long progress = 0;
+        if (journal.format == JOURNAL_TEXT_COLOR && 
+            config.transactionsPerClient <= LLONG_MAX / 100 / config.numClients) {
+            long long totalTransactions = (long long)config.numClients * config.transactionsPerClient;
+            progress = (totalTransactionsCompleted * 100) / totalTransactions;
+        }
+        formatJournalRecord(text, rec, progress);
+    }
+}
+
+// Function to drain every ring once; returns the number of records written
+uint64_t drainJournal() {
+    pthread_mutex_lock(&journal.registryMutex);
+    vector<JournalRing*> rings = journal.rings;
+    pthread_mutex_unlock(&journal.registryMutex);
+    
+    ostringstream text;
+    string binary;
+    uint64_t drained = 0;
+    
+    for (JournalRing* ring : rings) {
+        uint64_t head = ring->head.load(memory_order_relaxed);
+        uint64_t tail = ring->tail.load(memory_order_acquire);
+        for (uint64_t i = head; i != tail; i++) {
+            processJournalRecord(ring->slots[i & ring->mask], text, binary);
+        }
+        ring->head.store(tail, memory_order_release);
+        drained += tail - head;
+    }
+    
+    if (drained > 0) {
+        if (journal.format == JOURNAL_BINARY) {
+            fwrite(binary.data(), 1, binary.size(), journal.out);
+        } else {
+            string batch = text.str();
+            fwrite(batch.data(), 1, batch.size(), journal.out);
+        }
+        fflush(journal.out);
+        journal.written += drained;
+        journal.batches++;
+    }
+    return drained;
+}
+
+// Journal writer thread function
+void* journalWriterThread(void*) {
+    while (!journal.stopping.load(memory_order_acquire)) {
+        if (drainJournal() == 0) {
+            usleep(1000);
+        }
+    }
+    // Producers have finished; flush whatever is left
+    while (drainJournal() > 0) {}
+    return nullptr;
+}
+
+// Function to start the journal writer; out must stay open until stopJournal()
+bool startJournal(FILE* out, JournalFormat format, JournalPolicy policy, uint64_t ringCapacity) {
+    journal.enabled = true;
+    journal.format = format;
+    journal.policy = policy;
+    journal.ringCapacity = ringCapacity;
+    journal.out = out;
+    journal.stopping.store(false);
+    journal.written = 0;
+    journal.batches = 0;
+    journal.deposited = 0;
+    journal.withdrawn = 0;
+    if (format == JOURNAL_CSV) fputs("client,op,from,to,amount,timestamp\n", out);
+    pthread_mutex_init(&journal.registryMutex, nullptr);
+    return pthread_create(&journal.writer, nullptr, journalWriterThread, nullptr) == 0;
+}
+
+// Function to stop the writer after all producers are done; returns dropped records
+uint64_t stopJournal() {
+    if (!journal.enabled) return 0;
+    journal.stopping.store(true, memory_order_release);
+    pthread_join(journal.writer, nullptr);
+    
+    uint64_t dropped = 0;
+    for (JournalRing* ring : journal.rings) {
+        dropped += ring->dropped;
+        delete ring;
+    }
+    journal.rings.clear();
+    journal.generation++;
+    pthread_mutex_destroy(&journal.registryMutex);
+    journal.enabled = false;
+    return dropped;
+}
+
+// ---------------------------------------------------------------------------
+// Write-ahead log
+//
+// Successful operations are appended as fixed-size 32-byte records to a
+// pre-allocated, memory-mapped segment. An append only reserves a slot with
+// one fetch_add and fills it in place; the record's sequence word is stored
+// last. An operation takes its slot before it changes any balance, and is
+// refused if the segment is full, so every acknowledged operation is logged.
+// Reopening a segment grows it to hold the requested number of new records. A flusher thread performs group commit: once per commit interval
+// (or once --wal-batch records are pending) it msyncs the contiguous prefix
+// of finished records and publishes it as durable. With --wal-sync clients
+// wait for the group commit covering their operation before they continue.
+//
+// Records are appended inside the engine's critical section (under the
+// account locks, or on the owning shard), so the log order never lets a
+// debit precede the credit that funded it. Recovery replays the longest
+// valid prefix: each slot's sequence word must name that slot, generations
+// must not go backwards and the checksum must match.
+// ---------------------------------------------------------------------------
+
+const uint64_t WAL_MAGIC = 0x314c4157594e4142ULL;   // "BANYWAL1"
+const uint32_t WAL_VERSION = 1;
+const size_t WAL_HEADER_BYTES = 4096;               // records start on their own page
+const int WAL_GENERATION_SHIFT = 48;
+
+Wal wal;
+
+// Operations this thread has had refused because the segment was full; callers compare it
+// before and after an operation to tell a refusal from a lack of funds
+thread_local uint64_t threadWalRefusals = 0;
+
+// Function to checksum a record's payload together with its sequence word
+uint32_t walChecksum(const WalRecord& record, uint64_t sequence) {
+    uint64_t h = sequence * 0x9e3779b97f4a7c15ULL;
+    h ^= (uint64_t)record.amount + 0x632be59bd9b4e019ULL + (h << 6) + (h >> 2);
+    h ^= ((uint64_t)(uint32_t)record.accountIndex << 32 | (uint32_t)record.toAccountIndex) 
+       + (h << 6) + (h >> 2);
+    h ^= record.op + (h << 6) + (h >> 2);
+    h ^= h >> 31;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+// Function to log an operation before it is applied (call inside the engine's critical section,
+// before any balance changes); returns false if the segment is full and the operation must be refused
+bool walAppend(OpType op, int accountIndex, int toAccountIndex, Money amount) {
+    uint64_t slot = wal.tail.fetch_add(1, memory_order_relaxed);
+    if (slot >= wal.capacity) {
+        if (wal.overflow.fetch_add(1, memory_order_relaxed) == 0) {
+            cerr << "WAL segment full (" << wal.capacity << " records): refusing further operations" << endl;
+        }
+        threadWalRefusals++;
+        return false;
+    }
+    WalRecord& record = wal.records[slot];
+    uint64_t sequence = (wal.generation << WAL_GENERATION_SHIFT) | (slot + 1);
+    record.amount = amount;
+    record.accountIndex = accountIndex;
+    record.toAccountIndex = toAccountIndex;
+    record.op = (uint8_t)op;
+    record.checksum = walChecksum(record, sequence);
+    record.sequence.store(sequence, memory_order_release);
+    return true;
+}
+
+// Function to wait until every record appended so far is durable (--wal-sync)
+void walWaitForCommit() {
+    uint64_t target = min(wal.tail.load(memory_order_acquire), wal.capacity);
+    while (wal.durable.load(memory_order_acquire) < target) sched_yield();
+}
+
+// Function to msync the contiguous prefix of finished records (flusher thread only)
+void walCommit() {
+    uint64_t begin = wal.durable.load(memory_order_relaxed);
+    uint64_t limit = min(wal.tail.load(memory_order_acquire), wal.capacity);
+    uint64_t end = begin;
+    while (end < limit && wal.records[end].sequence.load(memory_order_acquire) 
+                          == ((wal.generation << WAL_GENERATION_SHIFT) | (end + 1))) {
+        end++;
+    }
+    if (end == begin) return;
+    
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t from = (WAL_HEADER_BYTES + begin * sizeof(WalRecord)) / page * page;
+    size_t to = WAL_HEADER_BYTES + end * sizeof(WalRecord);
+    uint64_t start = nowNanos();
+    msync(wal.base + from, to - from, MS_SYNC);
+    wal.commitNanos += nowNanos() - start;
+    wal.commits++;
+    wal.durable.store(end, memory_order_release);
+}
+
+// WAL flusher thread function: group commit per interval or batch
+void* walFlusherThread(void*) {
+    uint64_t pollMicros = wal.intervalNanos / 1000;
+    if (wal.batch > 0) pollMicros = min(pollMicros, (uint64_t)50);
+    uint64_t lastCommit = nowNanos();
+    
+    while (!wal.stopping.load(memory_order_acquire)) {
+        if (pollMicros > 0) usleep(pollMicros);
+        else sched_yield();
+        uint64_t now = nowNanos();
+        bool due = now - lastCommit >= wal.intervalNanos;
+        if (!due && wal.batch > 0) {
+            due = wal.tail.load(memory_order_relaxed) - wal.durable.load(memory_order_relaxed) >= wal.batch;
+        }
+        if (due) {
+            walCommit();
+            lastCommit = now;
+        }
+    }
+    // Producers have finished; make everything durable
+    walCommit();
+    return nullptr;
+}
+
+// Function to map an existing or new segment. A new writable segment is pre-allocated to capacity
+// records; an existing one is grown by startWal() to hold capacity records after the replayed ones.
+bool mapWal(const string& path, bool writable, uint64_t capacity) {
+    wal.reserve = capacity;
+    wal.fd = open(path.c_str(), writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if (wal.fd < 0) {
+        cerr << "Cannot open WAL " << path << ": " << strerror(errno) << endl;
+        return false;
+    }
+    struct stat st;
+    fstat(wal.fd, &st);
+    bool created = (st.st_size == 0);
+    if (created && !writable) {
+        cerr << "WAL " << path << " is empty" << endl;
+        return false;
+    }
+    
+    if (created) {
+        size_t bytes = WAL_HEADER_BYTES + capacity * sizeof(WalRecord);
+        int rc = posix_fallocate(wal.fd, 0, (off_t)bytes);
+        if (rc != 0) {
+            cerr << "Cannot pre-allocate " << bytes << " bytes for WAL " << path << ": " 
+                 << strerror(rc) << endl;
+            return false;
+        }
+        st.st_size = (off_t)bytes;
+    }
+    if ((size_t)st.st_size < WAL_HEADER_BYTES) {
+        cerr << "WAL " << path << " is truncated" << endl;
+        return false;
+    }
+    
+    wal.mappedBytes = (size_t)st.st_size;
+    void* mapped = mmap(nullptr, wal.mappedBytes, writable ? PROT_READ | PROT_WRITE : PROT_READ, 
+                        MAP_SHARED, wal.fd, 0);
+    if (mapped == MAP_FAILED) {
+        cerr << "Cannot map WAL " << path << ": " << strerror(errno) << endl;
+        return false;
+    }
+    wal.base = (char*)mapped;
+    wal.header = (WalHeader*)wal.base;
+    wal.records = (WalRecord*)(wal.base + WAL_HEADER_BYTES);
+    
+    if (created) {
+        wal.header->magic = WAL_MAGIC;
+        wal.header->version = WAL_VERSION;
+        wal.header->recordSize = sizeof(WalRecord);
+        wal.header->numAccounts = config.numAccounts;
+        wal.header->initialBalance = config.initialBalance;
+        wal.header->capacity = capacity;
+        wal.header->generation = 0;
+    } else if (wal.header->magic != WAL_MAGIC || wal.header->version != WAL_VERSION ||
+               wal.header->recordSize != sizeof(WalRecord) ||
+               WAL_HEADER_BYTES + wal.header->capacity * sizeof(WalRecord) > wal.mappedBytes) {
+        cerr << "WAL " << path << " has an unrecognized header" << endl;
+        return false;
+    }
+    wal.capacity = wal.header->capacity;
+    return true;
+}
+
+// Function to rebuild balances by replaying the longest valid prefix of the mapped segment.
+// The account store must already hold the opening balances; returns the records replayed.
+uint64_t replayWal() {
+    madvise(wal.base, wal.mappedBytes, MADV_SEQUENTIAL);
+    uint64_t generation = 0;
+    uint64_t slot = 0;
+    int count = (int)accounts.size();
+    
+    for (; slot < wal.capacity; slot++) {
+        const WalRecord& record = wal.records[slot];
+        uint64_t sequence = record.sequence.load(memory_order_relaxed);
+        uint64_t recordGeneration = sequence >> WAL_GENERATION_SHIFT;
+        if ((sequence & ((1ULL << WAL_GENERATION_SHIFT) - 1)) != slot + 1 || 
+            recordGeneration < generation || recordGeneration > wal.header->generation ||
+            record.checksum != walChecksum(record, sequence) ||
+            record.accountIndex < 0 || record.accountIndex >= count ||
+            (record.op == OP_TRANSFER && (record.toAccountIndex < 0 || record.toAccountIndex >= count))) {
+            break;
+        }
+        generation = recordGeneration;
+        
+        // Both accounts are validated above, so a transfer is never applied half-way
+        atomic<Money>& balance = accounts.balance(record.accountIndex);
+        Money delta = (record.op == OP_DEPOSIT) ? record.amount : -record.amount;
+        balance.store(balance.load(memory_order_relaxed) + delta, memory_order_relaxed);
+        if (record.op == OP_TRANSFER) {
+            atomic<Money>& toBalance = accounts.balance(record.toAccountIndex);
+            toBalance.store(toBalance.load(memory_order_relaxed) + record.amount, memory_order_relaxed);
+        }
+    }
+    return slot;
+}
+
+// Function to extend a writable segment to capacity records and map it again
+// (no other thread may touch the segment meanwhile)
+bool growWal(uint64_t capacity) {
+    if (capacity <= wal.capacity) return true;
+    size_t bytes = WAL_HEADER_BYTES + capacity * sizeof(WalRecord);
+    int rc = posix_fallocate(wal.fd, 0, (off_t)bytes);
+    if (rc != 0) {
+        cerr << "Cannot grow WAL to " << bytes << " bytes: " << strerror(rc) << endl;
+        return false;
+    }
+    munmap(wal.base, wal.mappedBytes);
+    void* mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, wal.fd, 0);
+    if (mapped == MAP_FAILED) {
+        cerr << "Cannot map WAL: " << strerror(errno) << endl;
+        wal.base = nullptr;
+        return false;
+    }
+    wal.mappedBytes = bytes;
+    wal.base = (char*)mapped;
+    wal.header = (WalHeader*)wal.base;
+    wal.records = (WalRecord*)(wal.base + WAL_HEADER_BYTES);
+    wal.header->capacity = capacity;
+    wal.capacity = capacity;
+    return true;
+}
+
+// Function to release the mapping
+void unmapWal() {
+    if (wal.base != nullptr) munmap(wal.base, wal.mappedBytes);
+    if (wal.fd >= 0) close(wal.fd);
+    wal.base = nullptr;
+    wal.fd = -1;
+}
+
+// Function to start appending to a segment mapped with mapWal(): existing records are
+// replayed into the (already initialized) account store first, new ones continue after them
+bool startWal(bool sync, double intervalMicros, uint64_t batch) {
+    uint64_t start = nowNanos();
+    wal.recovered = replayWal();
+    wal.recoveryNanos = nowNanos() - start;
+    if (!growWal(wal.recovered + wal.reserve)) return false;
+    
+    // A new generation keeps records left behind a torn tail from ever joining the replayed prefix
+    wal.generation = wal.header->generation + 1;
+    wal.header->generation = wal.generation;
+    msync(wal.base, WAL_HEADER_BYTES, MS_SYNC);
+    
+    wal.tail.store(wal.recovered);
+    wal.durable.store(wal.recovered);
+    wal.overflow.store(0);
+    wal.commits = 0;
+    wal.commitNanos = 0;
+    wal.sync = sync;
+    wal.intervalNanos = (uint64_t)(intervalMicros * 1000);
+    wal.batch = batch;
+    wal.stopping.store(false);
+    if (pthread_create(&wal.flusher, nullptr, walFlusherThread, nullptr) != 0) {
+        cerr << "Error creating WAL flusher thread" << endl;
+        return false;
+    }
+    wal.enabled = true;
+    return true;
+}
+
+// Function to stop the flusher after all producers are done (the final group commit runs first)
+void closeWal() {
+    if (!wal.enabled) return;
+    wal.stopping.store(true, memory_order_release);
+    pthread_join(wal.flusher, nullptr);
+    unmapWal();
+    wal.enabled = false;
+}
+
+// Function to log a transaction to the account history and the journal (when enabled)
+void logTransaction(int clientId, OpType op, bool success, int accountIndex, int toAccountIndex,
+                    Money amount, Money balanceAfter, Money toBalanceAfter, bool refused) {
+    bool keepHistory = history.enabled && success && (op == OP_DEPOSIT || op == OP_WITHDRAW);
+    if (!keepHistory && !journal.enabled) return;
+    
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t timestamp = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    
+    if (keepHistory) {
+        recordHistory(accounts, accountIndex, clientId, op, amount, balanceAfter, timestamp);
+    }
+    if (!journal.enabled) return;
+    
+    JournalRecord record;
+    record.timestamp = timestamp;
+    record.amount = amount;
+    record.balanceAfter = balanceAfter;
+    record.toBalanceAfter = toBalanceAfter;
+    record.clientId = clientId;
+    record.accountIndex = accountIndex;
+    record.toAccountIndex = toAccountIndex;
+    record.op = (uint8_t)op;
+    record.success = success ? 1 : 0;
+    record.outcome = (uint8_t)outcomeOf(op, success, refused);
+    record.reserved = 0;
+    journalAppend(record);
+}
+
+// ---------------------------------------------------------------------------
+// Online snapshots (epoch-based copy-on-write)
+//
+// A snapshot starts by bumping the global epoch; that instant is the cut.
+// Each writer reads the epoch once it holds every lock its operation needs,
+// and before it first modifies an account in the new epoch it copies the
+// old balance into the shadow array. The snapshot thread then visits each
+// account under its lock, just long enough to copy any balance nobody has
+// touched yet. Clients never wait for the whole pass, only ever for one
+// account, and for a single copy. Once the pass ends the shadow array holds
+// every balance as of the cut and stays stable until the next snapshot.
+// ---------------------------------------------------------------------------
+
+const uint64_t SNAPSHOT_MAGIC = 0x3150414e534b4e42ULL;   // "BNKSNAP1"
+const uint32_t SNAPSHOT_VERSION = 1;
+
+SnapshotState snapshots;
+
+// Function to copy an account's balance for the snapshot in progress; call under the
+// account's lock before modifying it, with the epoch read after all locks were taken
+inline void snapshotPreserve(int accountIndex, uint64_t epoch) {
+    if (snapshots.versions[accountIndex] < epoch) {
+        snapshots.shadow[accountIndex] = accounts.balance(accountIndex).load(memory_order_relaxed);
+        snapshots.versions[accountIndex] = epoch;
+        snapshots.copies.fetch_add(1, memory_order_relaxed);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Invariant auditor
+//
+// The auditor reuses the snapshot cut: after a pass, the shadow array is a
+// consistent image of every balance. Each thread keeps a ledger of the net
+// deposits minus withdrawals it committed, split at the last epoch it saw,
+// so the auditor can add up exactly the flows that happened before the cut
+// and check total == opening + deposits - withdrawals. Every committed
+// change also goes to the thread's audit trail, a small ring of recent
+// transactions with ids. When a check fails, the trail entries of the
+// failing window are replayed per account against the previous audit's
+// image, and the transactions on accounts that do not add up are reported.
+// ---------------------------------------------------------------------------
+
+// One committed transaction in a thread's audit trail (32 bytes, slot-level seqlock).
+// Its id is (ledger id, n) where n is its position in the thread's trail.
+struct AuditTrailEntry {
+    atomic<uint64_t> sequence;  // 2n + 1 while being written, 2n + 2 once complete
+    Money amount;
+    int32_t accountIndex;
+    int32_t toAccountIndex;
+    uint32_t epoch;
+    uint8_t op;
+};
+
+static_assert(sizeof(AuditTrailEntry) == 32, "audit trail entries should stay 32 bytes");
+
+// Per-thread ledger; written only by its thread, read by the auditor
+struct AuditLedger {
+    alignas(64) atomic<uint64_t> epoch;  // epoch of the thread's latest committed change
+    atomic<Money> netBefore;             // net flow of the thread's changes before that epoch
+    atomic<Money> net;                   // net flow of all the thread's changes
+    atomic<uint64_t> count;              // trail entries written
+    uint64_t id;
+    uint64_t mask;
+    AuditTrailEntry* trail;
+    uint64_t windowStart;                // auditor only: count before the previous cut
+};
+
+Auditor audit;
+thread_local AuditLedger* threadAuditLedger = nullptr;
+
+// Function to find (or create) the calling thread's ledger
+AuditLedger* getAuditLedger() {
+    if (threadAuditLedger == nullptr) {
+        AuditLedger* ledger = new AuditLedger();
+        ledger->epoch.store(0, memory_order_relaxed);
+        ledger->netBefore.store(0, memory_order_relaxed);
+        ledger->net.store(0, memory_order_relaxed);
+        ledger->count.store(0, memory_order_relaxed);
+        ledger->mask = audit.trailCapacity - 1;
+        ledger->trail = new AuditTrailEntry[audit.trailCapacity];
+        for (uint64_t i = 0; i < audit.trailCapacity; i++) ledger->trail[i].sequence.store(0);
+        ledger->windowStart = 0;
+        pthread_mutex_lock(&audit.registryMutex);
+        ledger->id = audit.ledgers.size();
+        audit.ledgers.push_back(ledger);
+        pthread_mutex_unlock(&audit.registryMutex);
+        threadAuditLedger = ledger;
+    }
+    return threadAuditLedger;
+}
+
+// Function to record a committed balance change for the auditor; call inside the
+// critical section with the same epoch that was used for snapshotPreserve
+void auditRecord(uint64_t epoch, OpType op, int accountIndex, int toAccountIndex, Money amount) {
+    AuditLedger* ledger = getAuditLedger();
+    Money net = ledger->net.load(memory_order_relaxed);
+    if (epoch != ledger->epoch.load(memory_order_relaxed)) {
+        ledger->netBefore.store(net, memory_order_relaxed);
+        ledger->epoch.store(epoch, memory_order_release);
+    }
+    if (op == OP_DEPOSIT) ledger->net.store(net + amount, memory_order_release);
+    if (op == OP_WITHDRAW) ledger->net.store(net - amount, memory_order_release);
+    
+    uint64_t count = ledger->count.load(memory_order_relaxed);
+    AuditTrailEntry& entry = ledger->trail[count & ledger->mask];
+    entry.sequence.store(2 * count + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    entry.epoch = (uint32_t)epoch;
+    entry.amount = amount;
+    entry.accountIndex = accountIndex;
+    entry.toAccountIndex = toAccountIndex;
+    entry.op = (uint8_t)op;
+    entry.sequence.store(2 * count + 2, memory_order_release);
+    ledger->count.store(count + 1, memory_order_release);
+}
+
+// ---------------------------------------------------------------------------
+// Account locks
+//
+// Critical sections are a few instructions long, so parking in the kernel
+// on the first conflict (what pthread_mutex_t does) costs far more than the
+// wait itself. --lock picks the implementation for every account:
+//   mutex     pthread_mutex_t
+//   spin      test-and-test-and-set on a 32-bit word, with randomized
+//             exponential backoff that turns into sched_yield
+//   adaptive  spins on the word for a while, then sleeps on a futex
+//             (0 = free, 1 = held, 2 = held with sleepers)
+//   seqlock   writers take the word like the spinlock but leave it even and
+//             one higher when they release it; balance reads never write the
+//             word, they retry if it was odd or changed while they read
+// ---------------------------------------------------------------------------
+
+const int SPIN_YIELD_AFTER = 6;     // backoff rounds that spin before yielding the core
+const int ADAPTIVE_SPINS = 100;     // pauses the adaptive lock spins before it sleeps
+
+static_assert(sizeof(atomic<uint32_t>) == sizeof(uint32_t), "lock words must be plain 32-bit words");
+
+// Function to pause the core briefly while spinning
+inline void cpuRelax() {
+#if defined(__x86_64__)
+    _mm_pause();
+#endif
+}
+
+// Function to back off after a failed attempt: randomized exponential spinning, then yielding
+void spinBackoff(int attempt) {
+    if (attempt >= SPIN_YIELD_AFTER) {
+        sched_yield();
+        return;
+    }
+    thread_local uint64_t jitter = (uint64_t)(uintptr_t)&jitter | 1;
+    jitter ^= jitter << 13;
+    jitter ^= jitter >> 7;
+    jitter ^= jitter << 17;
+    uint64_t spins = jitter % (16ULL << attempt) + 1;
+    for (uint64_t i = 0; i < spins; i++) cpuRelax();
+}
+
+// Function to sleep while *word == expected, and to wake one sleeper
+void futexWait(atomic<uint32_t>& word, uint32_t expected) {
+#if defined(__linux__)
+    syscall(SYS_futex, (uint32_t*)&word, FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+#else
+    if (word.load(memory_order_relaxed) == expected) sched_yield();
+#endif
+}
+
+void futexWake(atomic<uint32_t>& word) {
+#if defined(__linux__)
+    syscall(SYS_futex, (uint32_t*)&word, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+    (void)word;
+#endif
+}
+
+// Function to take a spin or seqlock word once if it is free (even); returns false if it is held
+inline bool tryLockWord(atomic<uint32_t>& word) {
+    uint32_t value = word.load(memory_order_relaxed);
+    return (value & 1) == 0 && word.compare_exchange_strong(value, value + 1, memory_order_acquire);
+}
+
+// Function to try to take an account's lock without waiting
+bool tryLockAccount(int accountIndex) {
+    switch (accounts.lockPolicy) {
+        case LOCK_MUTEX:
+            return pthread_mutex_trylock(accounts.lock(accountIndex)) == 0;
+        case LOCK_ADAPTIVE: {
+            uint32_t expected = 0;
+            return accounts.lockWord(accountIndex).compare_exchange_strong(expected, 1, memory_order_acquire);
+        }
+        default:
+            return tryLockWord(accounts.lockWord(accountIndex));
+    }
+}
+
+// Function to wait for an adaptive lock: spin while the holder is likely to finish soon, then sleep
+void adaptiveLock(atomic<uint32_t>& word) {
+    for (int i = 0; i < ADAPTIVE_SPINS; i++) {
+        uint32_t expected = 0;
+        if (word.load(memory_order_relaxed) == 0 && 
+            word.compare_exchange_weak(expected, 1, memory_order_acquire)) return;
+        cpuRelax();
+    }
+    // Mark the lock as having sleepers; whoever unlocks it will wake one of them
+    while (word.exchange(2, memory_order_acquire) != 0) futexWait(word, 2);
+}
+
+// Function to lock an account, counting and timing the acquisition if it has to wait
+void lockAccount(int accountIndex) {
+    if (tryLockAccount(accountIndex)) {
+        if (accounts.lockPolicy == LOCK_SEQLOCK) atomic_thread_fence(memory_order_release);
+        return;
+    }
+    
+    uint64_t start = nowNanos();
+    switch (accounts.lockPolicy) {
+        case LOCK_MUTEX:
+            pthread_mutex_lock(accounts.lock(accountIndex));
+            break;
+        case LOCK_ADAPTIVE:
+            adaptiveLock(accounts.lockWord(accountIndex));
+            break;
+        default:
+            for (int attempt = 0; !tryLockWord(accounts.lockWord(accountIndex)); attempt++) spinBackoff(attempt);
+            // Seqlock readers must see the odd sequence before any balance this writer stores
+            if (accounts.lockPolicy == LOCK_SEQLOCK) atomic_thread_fence(memory_order_release);
+            break;
+    }
+    AccountContention& contention = accounts.contention[accountIndex];
+    contention.blocked.fetch_add(1, memory_order_relaxed);
+    contention.waitNanos.fetch_add(nowNanos() - start, memory_order_relaxed);
+}
+
+// Function to unlock an account
+void unlockAccount(int accountIndex) {
+    switch (accounts.lockPolicy) {
+        case LOCK_MUTEX:
+            pthread_mutex_unlock(accounts.lock(accountIndex));
+            break;
+        case LOCK_SPIN:
+            accounts.lockWord(accountIndex).store(0, memory_order_release);
+            break;
+        case LOCK_ADAPTIVE:
+            if (accounts.lockWord(accountIndex).exchange(0, memory_order_release) == 2) {
+                futexWake(accounts.lockWord(accountIndex));
+            }
+            break;
+        default: {
+            atomic<uint32_t>& sequence = accounts.lockWord(accountIndex);
+            sequence.store(sequence.load(memory_order_relaxed) + 1, memory_order_release);
+            break;
+        }
+    }
+}
+
+// Function to read a balance without blocking writers: retry until no writer held the
+// account's seqlock while the balance was read
+Money seqlockBalance(int accountIndex) {
+    atomic<uint32_t>& sequence = accounts.lockWord(accountIndex);
+    for (int attempt = 0; ; attempt++) {
+        uint32_t before = sequence.load(memory_order_acquire);
+        if ((before & 1) == 0) {
+            Money balance = accounts.balance(accountIndex).load(memory_order_relaxed);
+            atomic_thread_fence(memory_order_acquire);
+            if (sequence.load(memory_order_relaxed) == before) return balance;
+        }
+        spinBackoff(attempt);
+    }
+}
+
+// Function to deposit money
+bool deposit(int clientId, int accountIndex, Money amount) {
+    lockAccount(accountIndex);
+    
+    atomic<Money>& balance = accounts.balance(accountIndex);
+    Money newBalance = balance.load(memory_order_relaxed);
+    // In durable mode the deposit only happens if the log has room for it
+    bool success = !wal.enabled || walAppend(OP_DEPOSIT, accountIndex, -1, amount);
+    if (success) {
+        if (snapshots.enabled) {
+            uint64_t epoch = snapshots.epoch.load(memory_order_acquire);
+            snapshotPreserve(accountIndex, epoch);
+            if (audit.enabled) auditRecord(epoch, OP_DEPOSIT, accountIndex, -1, amount);
+        }
+        newBalance += amount;
+        balance.store(newBalance, memory_order_relaxed);
+    }
+    
+    unlockAccount(accountIndex);
+    
+    logTransaction(clientId, OP_DEPOSIT, success, accountIndex, -1, amount, newBalance, 0, !success);
+    return success;
+}
+
+// Function to withdraw money
+bool withdraw(int clientId, int accountIndex, Money amount) {
+    bool success = false;
+    
+    lockAccount(accountIndex);
+    
+    atomic<Money>& balance = accounts.balance(accountIndex);
+    Money currentBalance = balance.load(memory_order_relaxed);
+    bool funded = currentBalance >= amount;
+    bool refused = funded && wal.enabled && !walAppend(OP_WITHDRAW, accountIndex, -1, amount);
+    if (funded && !refused) {
+        if (snapshots.enabled) {
+            uint64_t epoch = snapshots.epoch.load(memory_order_acquire);
+            snapshotPreserve(accountIndex, epoch);
+            if (audit.enabled) auditRecord(epoch, OP_WITHDRAW, accountIndex, -1, amount);
+        }
+        currentBalance -= amount;
+        balance.store(currentBalance, memory_order_relaxed);
+        success = true;
+    }
+    
+    unlockAccount(accountIndex);
+    
+    logTransaction(clientId, OP_WITHDRAW, success, accountIndex, -1, amount, currentBalance, 0, refused);
+    return success;
+}
+
+// Function to transfer money between accounts
+bool transfer(int clientId, int fromAccountIndex, int toAccountIndex, Money amount) {
+    // Lock both accounts in order to prevent deadlock
+    int first = min(fromAccountIndex, toAccountIndex);
+    int second = max(fromAccountIndex, toAccountIndex);
+    
+    lockAccount(first);
+    lockAccount(second);
+    
+    atomic<Money>& fromBalance = accounts.balance(fromAccountIndex);
+    atomic<Money>& toBalance = accounts.balance(toAccountIndex);
+    Money fromBalanceAfter = fromBalance.load(memory_order_relaxed);
+    Money toBalanceAfter = toBalance.load(memory_order_relaxed);
+    bool success = false;
+    bool funded = fromBalanceAfter >= amount;
+    bool refused = funded && wal.enabled && !walAppend(OP_TRANSFER, fromAccountIndex, toAccountIndex, amount);
+    if (funded && !refused) {
+        if (snapshots.enabled) {
+            uint64_t epoch = snapshots.epoch.load(memory_order_acquire);
+            snapshotPreserve(fromAccountIndex, epoch);
+            snapshotPreserve(toAccountIndex, epoch);
+            if (audit.enabled) auditRecord(epoch, OP_TRANSFER, fromAccountIndex, toAccountIndex, amount);
+        }
+        fromBalanceAfter -= amount;
+        toBalanceAfter += amount;
+        fromBalance.store(fromBalanceAfter, memory_order_relaxed);
+        toBalance.store(toBalanceAfter, memory_order_relaxed);
+        success = true;
+    }
+    
+    unlockAccount(second);
+    unlockAccount(first);
+    
+    logTransaction(clientId, OP_TRANSFER, success, fromAccountIndex, toAccountIndex, 
+                   amount, fromBalanceAfter, toBalanceAfter, refused);
+    return success;
+}
+
+// Function to execute a batch of transfers under group locking. Every distinct
+// account touched by the batch is locked once, in ascending index order (so
+// batches cannot deadlock with each other or with single transfers), then the
+// transfers are applied in submission order and all locks are released.
+// Returns the number of successful transfers; results[i] describes request i.
+int transferBatch(int clientId, const TransferRequest* requests, int count, TransferResult* results) {
+    thread_local vector<int32_t> lockSet;
+    lockSet.clear();
+    for (int i = 0; i < count; i++) {
+        lockSet.push_back(requests[i].fromIndex);
+        lockSet.push_back(requests[i].toIndex);
+    }
+    sort(lockSet.begin(), lockSet.end());
+    lockSet.erase(unique(lockSet.begin(), lockSet.end()), lockSet.end());
+    
+    for (int32_t index : lockSet) lockAccount(index);
+    uint64_t epoch = 0;
+    if (snapshots.enabled) {
+        epoch = snapshots.epoch.load(memory_order_acquire);
+        for (int32_t index : lockSet) snapshotPreserve(index, epoch);
+    }
+    
+    int succeeded = 0;
+    for (int i = 0; i < count; i++) {
+        atomic<Money>& fromBalance = accounts.balance(requests[i].fromIndex);
+        atomic<Money>& toBalance = accounts.balance(requests[i].toIndex);
+        Money fromBalanceAfter = fromBalance.load(memory_order_relaxed);
+        Money toBalanceAfter = toBalance.load(memory_order_relaxed);
+        bool funded = fromBalanceAfter >= requests[i].amount;
+        results[i].success = false;
+        results[i].refused = funded && wal.enabled && 
+                             !walAppend(OP_TRANSFER, requests[i].fromIndex, requests[i].toIndex, requests[i].amount);
+        if (funded && !results[i].refused) {
+            if (snapshots.enabled) {
+                // Accounts were preserved for this epoch when the batch took its locks
+                if (audit.enabled) {
+                    auditRecord(epoch, OP_TRANSFER, requests[i].fromIndex, requests[i].toIndex, 
+                                requests[i].amount);
+                }
+            }
+            fromBalanceAfter -= requests[i].amount;
+            toBalanceAfter += requests[i].amount;
+            fromBalance.store(fromBalanceAfter, memory_order_relaxed);
+            toBalance.store(toBalanceAfter, memory_order_relaxed);
+            results[i].success = true;
+            succeeded++;
+        }
+        results[i].fromBalanceAfter = fromBalanceAfter;
+        results[i].toBalanceAfter = toBalanceAfter;
+    }
+    
+    for (int k = (int)lockSet.size() - 1; k >= 0; k--) unlockAccount(lockSet[k]);
+    
+    for (int i = 0; i < count; i++) {
+        logTransaction(clientId, OP_TRANSFER, results[i].success, requests[i].fromIndex, 
+                       requests[i].toIndex, requests[i].amount, 
+                       results[i].fromBalanceAfter, results[i].toBalanceAfter, results[i].refused);
+    }
+    return succeeded;
+}
+
+// One account touched by a multi-account operation and its net change
+struct Leg {
+    int32_t accountIndex;
+    Money delta;
+};
+
+// Function to turn "payer pays amount to each payee" into distinct legs sorted by account
+// index (a payee that appears twice, or is the payer, becomes one leg); returns the leg count
+int buildLegs(int payerIndex, const int32_t* payees, int count, Money amount, Leg* legs) {
+    legs[0].accountIndex = payerIndex;
+    legs[0].delta = -amount * count;
+    for (int j = 0; j < count; j++) {
+        legs[j + 1].accountIndex = payees[j];
+        legs[j + 1].delta = amount;
+    }
+    sort(legs, legs + count + 1, [](const Leg& a, const Leg& b) { return a.accountIndex < b.accountIndex; });
+    int distinct = 0;
+    for (int k = 0; k <= count; k++) {
+        if (distinct > 0 && legs[distinct - 1].accountIndex == legs[k].accountIndex) {
+            legs[distinct - 1].delta += legs[k].delta;
+        } else {
+            legs[distinct++] = legs[k];
+        }
+    }
+    return distinct;
+}
+
+// Function to pay amount from one account to each of count payees as one atomic operation.
+// This is transfer() generalized to N accounts: every distinct account is locked once, in
+// ascending index order, and nothing is applied unless the payer can cover the whole payment.
+bool multiTransfer(int clientId, int payerIndex, const int32_t* payees, int count, Money amount) {
+    thread_local vector<Leg> legs;
+    legs.resize(count + 1);
+    int distinct = buildLegs(payerIndex, payees, count, amount, legs.data());
+    
+    for (int k = 0; k < distinct; k++) lockAccount(legs[k].accountIndex);
+    
+    bool success = true;
+    for (int k = 0; k < distinct; k++) {
+        if (accounts.balance(legs[k].accountIndex).load(memory_order_relaxed) + legs[k].delta < 0) {
+            success = false;
+        }
+    }
+    if (success) {
+        if (snapshots.enabled) {
+            uint64_t epoch = snapshots.epoch.load(memory_order_acquire);
+            for (int k = 0; k < distinct; k++) snapshotPreserve(legs[k].accountIndex, epoch);
+            if (audit.enabled) {
+                for (int j = 0; j < count; j++) auditRecord(epoch, OP_TRANSFER, payerIndex, payees[j], amount);
+            }
+        }
+        for (int k = 0; k < distinct; k++) {
+            atomic<Money>& balance = accounts.balance(legs[k].accountIndex);
+            balance.store(balance.load(memory_order_relaxed) + legs[k].delta, memory_order_relaxed);
+        }
+    }
+    Money payerBalance = accounts.balance(payerIndex).load(memory_order_relaxed);
+    
+    for (int k = distinct - 1; k >= 0; k--) unlockAccount(legs[k].accountIndex);
+    
+    logTransaction(clientId, OP_MULTI, success, payerIndex, -1, amount * count, payerBalance);
+    return success;
+}
+
+// ---------------------------------------------------------------------------
+// Atomic engine: balances are updated without any mutex. Deposits are a
+// single fetch_add, withdrawals a CAS loop that refuses to go below zero.
+// A transfer is a withdrawal followed by a deposit; the amount is briefly in
+// flight between the two accounts, but no balance ever goes negative and
+// money is conserved once both steps finish.
+// ---------------------------------------------------------------------------
+
+// Function to subtract amount unless that would overdraw the account; failed CASes count as contention
+bool atomicDebit(int accountIndex, Money amount, Money& balanceAfter) {
+    atomic<Money>& balance = accounts.balance(accountIndex);
+    Money current = balance.load(memory_order_relaxed);
+    uint64_t retries = 0;
+    bool success = false;
+    while (current >= amount) {
+        if (balance.compare_exchange_weak(current, current - amount, memory_order_acq_rel,
+                                          memory_order_relaxed)) {
+            success = true;
+            break;
+        }
+        retries++;
+    }
+    if (retries > 0) accounts.contention[accountIndex].blocked.fetch_add(retries, memory_order_relaxed);
+    balanceAfter = success ? current - amount : current;
+    return success;
+}
+
+// Function to deposit money without locks
+bool atomicDeposit(int clientId, int accountIndex, Money amount) {
+    Money newBalance = accounts.balance(accountIndex).fetch_add(amount, memory_order_acq_rel) + amount;
+    
+    logTransaction(clientId, OP_DEPOSIT, true, accountIndex, -1, amount, newBalance);
+    return true;
+}
+
+// Function to withdraw money without locks
+bool atomicWithdraw(int clientId, int accountIndex, Money amount) {
+    Money balanceAfter;
+    bool success = atomicDebit(accountIndex, amount, balanceAfter);
+    
+    logTransaction(clientId, OP_WITHDRAW, success, accountIndex, -1, amount, balanceAfter);
+    return success;
+}
+
+// Function to transfer money without locks
+bool atomicTransfer(int clientId, int fromAccountIndex, int toAccountIndex, Money amount) {
+    Money fromBalance;
+    Money toBalance = 0;
+    bool success = atomicDebit(fromAccountIndex, amount, fromBalance);
+    if (success) {
+        toBalance = accounts.balance(toAccountIndex).fetch_add(amount, memory_order_acq_rel) + amount;
+    }
+    
+    logTransaction(clientId, OP_TRANSFER, success, fromAccountIndex, toAccountIndex, 
+                   amount, fromBalance, toBalance);
+    return success;
+}
+
+// Function to execute a batch of transfers one by one (the atomic engine takes no locks to amortize)
+int atomicTransferBatch(int clientId, const TransferRequest* requests, int count, TransferResult* results) {
+    int succeeded = 0;
+    for (int i = 0; i < count; i++) {
+        Money fromBalance;
+        Money toBalance = 0;
+        results[i].success = atomicDebit(requests[i].fromIndex, requests[i].amount, fromBalance);
+        results[i].refused = false;
+        if (results[i].success) {
+            toBalance = accounts.balance(requests[i].toIndex).fetch_add(requests[i].amount, 
+                                                                        memory_order_acq_rel) 
+                      + requests[i].amount;
+            succeeded++;
+        }
+        results[i].fromBalanceAfter = fromBalance;
+        results[i].toBalanceAfter = toBalance;
+        logTransaction(clientId, OP_TRANSFER, results[i].success, requests[i].fromIndex, 
+                       requests[i].toIndex, requests[i].amount, fromBalance, toBalance);
+    }
+    return succeeded;
+}
+
+// Function to read a balance kept by the atomic engine
+Money atomicBalance(int accountIndex) {
+    return accounts.balance(accountIndex).load(memory_order_acquire);
+}
+
+// Function to read a balance kept by the mutex engine
+Money mutexBalance(int accountIndex) {
+    if (accounts.lockPolicy == LOCK_SEQLOCK) return seqlockBalance(accountIndex);
+    lockAccount(accountIndex);
+    Money balance = accounts.balance(accountIndex).load(memory_order_relaxed);
+    unlockAccount(accountIndex);
+    return balance;
+}
+
+// ---------------------------------------------------------------------------
+// Sharded engine: accounts are partitioned across shard threads (account i
+// belongs to shard i % shards) and only the owning shard ever writes a
+// balance, so no lock or CAS is taken on account state. Clients post
+// messages to the owning shard's MPSC inbox and wait for the reply.
+//
+// A transfer between two shards is a two-phase message: the source shard
+// debits (refusing to overdraw) and forwards the same message to the
+// destination shard, which credits and completes it. Between the two phases
+// the amount is counted as in flight, so money is conserved at all times as
+// balances + in flight, and exactly once the transfer completes.
+// ---------------------------------------------------------------------------
+
+enum ShardPhase {
+    SHARD_APPLY = 0,    // deposit, withdrawal or same-shard transfer
+    SHARD_DEBIT,        // first phase of a cross-shard transfer
+    SHARD_CREDIT        // second phase, executed by the destination shard
+};
+
+// Request travelling through the shard inboxes; it lives with the client that waits on it
+struct ShardMessage {
+    atomic<ShardMessage*> next;
+    Money amount;
+    Money balanceAfter;
+    Money toBalanceAfter;
+    int32_t accountIndex;
+    int32_t toAccountIndex;
+    uint8_t op;
+    uint8_t phase;
+    bool success;
+    bool refused;               // failed because the write-ahead log was full
+    atomic<int> done;
+};
+
+// Vyukov intrusive multi-producer/single-consumer queue: producers swap the
+// head, the owning shard consumes from the tail. A stub node keeps it non-empty.
+struct ShardInbox {
+    alignas(64) atomic<ShardMessage*> head;
+    alignas(64) ShardMessage* tail;
+    ShardMessage stub;
+    
+    ShardInbox() {
+        stub.next.store(nullptr, memory_order_relaxed);
+        head.store(&stub, memory_order_relaxed);
+        tail = &stub;
+    }
+    
+    // Called by any thread
+    void push(ShardMessage* message) {
+        message->next.store(nullptr, memory_order_relaxed);
+        ShardMessage* previous = head.exchange(message, memory_order_acq_rel);
+        previous->next.store(message, memory_order_release);
+    }
+    
+    // Called by the owning shard only; returns nullptr when empty (or a push is half done)
+    ShardMessage* pop() {
+        ShardMessage* current = tail;
+        ShardMessage* next = current->next.load(memory_order_acquire);
+        if (current == &stub) {
+            if (next == nullptr) return nullptr;
+            tail = next;
+            current = next;
+            next = next->next.load(memory_order_acquire);
+        }
+        if (next != nullptr) {
+            tail = next;
+            return current;
+        }
+        if (current != head.load(memory_order_acquire)) return nullptr;
+        push(&stub);
+        next = current->next.load(memory_order_acquire);
+        if (next != nullptr) {
+            tail = next;
+            return current;
+        }
+        return nullptr;
+    }
+};
+
+struct Shard {
+    int id;
+    pthread_t thread;
+    ShardInbox inbox;
+    // Written only by the shard thread, read after it has been joined
+    uint64_t messages;
+    uint64_t forwarded;         // cross-shard debits handed to another shard
+    Money debitedOut;           // money sent to other shards
+    Money creditedIn;           // money received from other shards
+};
+
+ShardSet shardSet;
+
+// Function to find the shard that owns an account
+inline Shard* shardOf(int accountIndex) {
+    return shardSet.shards[accountIndex % shardSet.shards.size()];
+}
+
+// Function to apply one message on the shard that owns its (first) account
+void processShardMessage(Shard* shard, ShardMessage* message) {
+    atomic<Money>& balance = accounts.balance(message->accountIndex);
+    
+    if (message->phase == SHARD_CREDIT) {
+        atomic<Money>& toBalance = accounts.balance(message->toAccountIndex);
+        message->toBalanceAfter = toBalance.load(memory_order_relaxed) + message->amount;
+        toBalance.store(message->toBalanceAfter, memory_order_relaxed);
+        shard->creditedIn += message->amount;
+        message->success = true;
+        message->done.store(1, memory_order_release);
+        return;
+    }
+    
+    Money current = balance.load(memory_order_relaxed);
+    bool funded = (message->op == OP_DEPOSIT || current >= message->amount);
+    // A cross-shard transfer is logged whole by its source shard, before the credit is sent
+    message->refused = funded && wal.enabled && 
+                       !walAppend((OpType)message->op, message->accountIndex, message->toAccountIndex, message->amount);
+    if (!funded || message->refused) {
+        message->balanceAfter = current;
+        message->success = false;
+    } else if (message->op == OP_DEPOSIT) {
+        message->balanceAfter = current + message->amount;
+        balance.store(message->balanceAfter, memory_order_relaxed);
+        message->success = true;
+    } else {
+        message->balanceAfter = current - message->amount;
+        balance.store(message->balanceAfter, memory_order_relaxed);
+        message->success = true;
+        if (message->phase == SHARD_DEBIT) {
+            // Hand the message to the destination shard; it completes the transfer
+            shard->debitedOut += message->amount;
+            shard->forwarded++;
+            message->phase = SHARD_CREDIT;
+            shardOf(message->toAccountIndex)->inbox.push(message);
+            return;
+        }
+        if (message->op == OP_TRANSFER) {
+            atomic<Money>& toBalance = accounts.balance(message->toAccountIndex);
+            message->toBalanceAfter = toBalance.load(memory_order_relaxed) + message->amount;
+            toBalance.store(message->toBalanceAfter, memory_order_relaxed);
+        }
+    }
+    message->done.store(1, memory_order_release);
+}
+
+// Shard thread function: drain the inbox until stopped and empty
+void* shardThread(void* arg) {
+    Shard* shard = (Shard*)arg;
+    
+    while (true) {
+        ShardMessage* message = shard->inbox.pop();
+        if (message != nullptr) {
+            processShardMessage(shard, message);
+            shard->messages++;
+            continue;
+        }
+        if (!shardSet.running.load(memory_order_acquire)) break;
+        sched_yield();
+    }
+    return nullptr;
+}
+
+// Function to post a message to the shard owning its account (the client keeps ownership of it)
+void postShardMessage(ShardMessage& message, OpType op, int accountIndex, int toAccountIndex, Money amount) {
+    message.op = (uint8_t)op;
+    message.accountIndex = accountIndex;
+    message.toAccountIndex = toAccountIndex;
+    message.amount = amount;
+    message.balanceAfter = 0;
+    message.toBalanceAfter = 0;
+    message.success = false;
+    message.refused = false;
+    message.phase = SHARD_APPLY;
+    if (op == OP_TRANSFER && shardOf(accountIndex) != shardOf(toAccountIndex)) message.phase = SHARD_DEBIT;
+    message.done.store(0, memory_order_relaxed);
+    shardOf(accountIndex)->inbox.push(&message);
+}
+
+// Function to wait until a shard has completed a message: spin briefly, then yield
+void waitForShard(ShardMessage& message) {
+    for (int spins = 0; message.done.load(memory_order_acquire) == 0; spins++) {
+        if (spins >= 64) sched_yield();
+    }
+}
+
+// Function to wait for a message and charge a WAL refusal on the shard to the waiting client
+void waitForShardReply(ShardMessage& message) {
+    waitForShard(message);
+    if (message.refused) threadWalRefusals++;
+}
+
+// Function to deposit money through the owning shard
+bool shardedDeposit(int clientId, int accountIndex, Money amount) {
+    ShardMessage message;
+    postShardMessage(message, OP_DEPOSIT, accountIndex, -1, amount);
+    waitForShardReply(message);
+    
+    logTransaction(clientId, OP_DEPOSIT, message.success, accountIndex, -1, amount, 
+                   message.balanceAfter, 0, message.refused);
+    return message.success;
+}
+
+// Function to withdraw money through the owning shard
+bool shardedWithdraw(int clientId, int accountIndex, Money amount) {
+    ShardMessage message;
+    postShardMessage(message, OP_WITHDRAW, accountIndex, -1, amount);
+    waitForShardReply(message);
+    
+    logTransaction(clientId, OP_WITHDRAW, message.success, accountIndex, -1, amount, 
+                   message.balanceAfter, 0, message.refused);
+    return message.success;
+}
+
+// Function to transfer money through the shards (two-phase when the accounts live on different shards)
+bool shardedTransfer(int clientId, int fromAccountIndex, int toAccountIndex, Money amount) {
+    ShardMessage message;
+    postShardMessage(message, OP_TRANSFER, fromAccountIndex, toAccountIndex, amount);
+    waitForShardReply(message);
+    
+    logTransaction(clientId, OP_TRANSFER, message.success, fromAccountIndex, toAccountIndex, 
+                   amount, message.balanceAfter, message.toBalanceAfter, message.refused);
+    return message.success;
+}
+
+const int SHARD_PIPELINE_DEPTH = 64;
+
+// Function to execute a batch of transfers by posting up to SHARD_PIPELINE_DEPTH of
+// them at once and then waiting for all replies. Transfers in flight together may
+// complete in any order; each one is still checked against overdraft on its own.
+int shardedTransferBatch(int clientId, const TransferRequest* requests, int count, TransferResult* results) {
+    ShardMessage messages[SHARD_PIPELINE_DEPTH];
+    int succeeded = 0;
+    for (int begin = 0; begin < count; begin += SHARD_PIPELINE_DEPTH) {
+        int end = min(count, begin + SHARD_PIPELINE_DEPTH);
+        for (int i = begin; i < end; i++) {
+            postShardMessage(messages[i - begin], OP_TRANSFER, requests[i].fromIndex, 
+                             requests[i].toIndex, requests[i].amount);
+        }
+        for (int i = begin; i < end; i++) {
+            ShardMessage& message = messages[i - begin];
+            waitForShard(message);
+            results[i].success = message.success;
+            results[i].refused = message.refused;
+            results[i].fromBalanceAfter = message.balanceAfter;
+            results[i].toBalanceAfter = message.toBalanceAfter;
+            if (message.success) succeeded++;
+            logTransaction(clientId, OP_TRANSFER, message.success, requests[i].fromIndex, 
+                           requests[i].toIndex, requests[i].amount, 
+                           message.balanceAfter, message.toBalanceAfter, message.refused);
+        }
+    }
+    return succeeded;
+}
+
+// Function to read a balance kept by the sharded engine (exact once the shards are idle)
+Money shardedBalance(int accountIndex) {
+    return accounts.balance(accountIndex).load(memory_order_acquire);
+}
+
+// Function to start the shard threads (config.shards of them)
+bool startShards() {
+    shardSet.running.store(true, memory_order_release);
+    for (int s = 0; s < config.shards; s++) {
+        Shard* shard = new Shard();
+        shard->id = s;
+        shard->messages = 0;
+        shard->forwarded = 0;
+        shard->debitedOut = 0;
+        shard->creditedIn = 0;
+        shardSet.shards.push_back(shard);
+    }
+    for (Shard* shard : shardSet.shards) {
+        if (pthread_create(&shard->thread, nullptr, shardThread, shard) != 0) {
+            cerr << "Error creating shard thread " << shard->id << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Function to stop the shard threads once every client is done and collect their counters
+void stopShards() {
+    shardSet.running.store(false, memory_order_release);
+    shardSet.messages = 0;
+    shardSet.forwarded = 0;
+    shardSet.inFlight = 0;
+    for (Shard* shard : shardSet.shards) {
+        pthread_join(shard->thread, nullptr);
+        shardSet.messages += shard->messages;
+        shardSet.forwarded += shard->forwarded;
+        shardSet.inFlight += shard->debitedOut - shard->creditedIn;
+    }
+    for (Shard* shard : shardSet.shards) delete shard;
+    shardSet.shards.clear();
+}
+
+// ---------------------------------------------------------------------------
+// Optimistic engine: every account has a version word next to its balance
+// (odd while a writer owns it). A transaction reads a consistent (version,
+// balance) pair for each account it touches, computes the new balances,
+// then commits by moving each version from the value it read to odd with a
+// CAS. It never waits for a lock: if any version changed, it releases what
+// it took, backs off and retries. A successful commit writes the balances
+// and publishes version + 2. Deposits, withdrawals and transfers are one-
+// and two-account transactions; multi-leg payments touch any number.
+// ---------------------------------------------------------------------------
+
+// Per-thread optimistic-concurrency counters; written by their thread, read after it has finished
+struct OccCounters {
+    uint64_t txns;
+    uint64_t aborts;            // attempts that found a conflict
+    uint64_t retried;           // transactions that needed more than one attempt
+};
+
+struct OccStats {
+    pthread_mutex_t registryMutex;  // taken once per thread
+    vector<OccCounters*> counters;
+    uint64_t generation;            // bumped by clearOccStats() so stale thread counters are dropped
+};
+
+OccStats occStats = { PTHREAD_MUTEX_INITIALIZER, {}, 0 };
+thread_local OccCounters* threadOccCounters = nullptr;
+thread_local uint64_t threadOccGeneration = 0;
+
+// Function to find (or create) the calling thread's counters
+OccCounters* getOccCounters() {
+    if (threadOccCounters == nullptr || threadOccGeneration != occStats.generation) {
+        threadOccCounters = new OccCounters();
+        threadOccGeneration = occStats.generation;
+        pthread_mutex_lock(&occStats.registryMutex);
+        occStats.counters.push_back(threadOccCounters);
+        pthread_mutex_unlock(&occStats.registryMutex);
+    }
+    return threadOccCounters;
+}
+
+// Function to sum every thread's counters (after the threads have finished)
+void getOccTotals(uint64_t& txns, uint64_t& aborts, uint64_t& retried) {
+    txns = aborts = retried = 0;
+    for (OccCounters* counters : occStats.counters) {
+        txns += counters->txns;
+        aborts += counters->aborts;
+        retried += counters->retried;
+    }
+}
+
+// Function to free every thread's counters (the bank is closed)
+void clearOccStats() {
+    for (OccCounters* counters : occStats.counters) delete counters;
+    occStats.counters.clear();
+    occStats.generation++;
+}
+
+// Function to run an optimistic transaction over distinct legs sorted by account index.
+// Returns false, writing nothing, if some account would go negative; balancesAfter[k]
+// receives leg k's balance after the commit (or its current balance on failure).
+bool occExecute(const Leg* legs, int count, Money* balancesAfter) {
+    thread_local vector<uint64_t> readVersions;
+    thread_local vector<Money> readBalances;
+    readVersions.resize(count);
+    readBalances.resize(count);
+    OccCounters* counters = getOccCounters();
+    counters->txns++;
+    
+    for (int attempt = 0; ; attempt++) {
+        if (attempt > 0) {
+            counters->aborts++;
+            if (attempt == 1) counters->retried++;
+            spinBackoff(attempt);
+        }
+        
+        // Read phase: a consistent (version, balance) pair per account, seqlock style
+        int conflict = -1;
+        bool funded = true;
+        for (int k = 0; k < count; k++) {
+            atomic<uint64_t>& version = accounts.version(legs[k].accountIndex);
+            uint64_t before = version.load(memory_order_acquire);
+            readBalances[k] = accounts.balance(legs[k].accountIndex).load(memory_order_relaxed);
+            atomic_thread_fence(memory_order_acquire);
+            if ((before & 1) != 0 || version.load(memory_order_relaxed) != before) {
+                conflict = k;
+                break;
+            }
+            readVersions[k] = before;
+            balancesAfter[k] = readBalances[k] + legs[k].delta;
+            if (balancesAfter[k] < 0) funded = false;
+        }
+        
+        // An overdraft only counts if what we read is still current
+        if (conflict < 0 && !funded) {
+            for (int k = 0; k < count && conflict < 0; k++) {
+                if (accounts.version(legs[k].accountIndex).load(memory_order_acquire) != readVersions[k]) {
+                    conflict = k;
+                }
+            }
+            if (conflict < 0) {
+                for (int k = 0; k < count; k++) balancesAfter[k] = readBalances[k];
+                return false;
+            }
+        }
+        
+        // Commit phase: take every version from the value we read to odd, in account order
+        int locked = 0;
+        if (conflict < 0) {
+            for (; locked < count; locked++) {
+                uint64_t expected = readVersions[locked];
+                if (!accounts.version(legs[locked].accountIndex)
+                         .compare_exchange_strong(expected, expected | 1, memory_order_acquire)) {
+                    conflict = locked;
+                    break;
+                }
+            }
+        }
+        if (conflict >= 0) {
+            // Nothing was written, so the versions we took go back unchanged
+            for (int k = locked - 1; k >= 0; k--) {
+                accounts.version(legs[k].accountIndex).store(readVersions[k], memory_order_release);
+            }
+            accounts.contention[legs[conflict].accountIndex].blocked.fetch_add(1, memory_order_relaxed);
+            continue;
+        }
+        
+        atomic_thread_fence(memory_order_release);
+        for (int k = 0; k < count; k++) {
+            accounts.balance(legs[k].accountIndex).store(balancesAfter[k], memory_order_relaxed);
+        }
+        for (int k = 0; k < count; k++) {
+            accounts.version(legs[k].accountIndex).store(readVersions[k] + 2, memory_order_release);
+        }
+        return true;
+    }
+}
+
+// Function to deposit money optimistically
+bool occDeposit(int clientId, int accountIndex, Money amount) {
+    Leg leg = { accountIndex, amount };
+    Money balanceAfter;
+    occExecute(&leg, 1, &balanceAfter);
+    
+    logTransaction(clientId, OP_DEPOSIT, true, accountIndex, -1, amount, balanceAfter);
+    return true;
+}
+
+// Function to withdraw money optimistically
+bool occWithdraw(int clientId, int accountIndex, Money amount) {
+    Leg leg = { accountIndex, -amount };
+    Money balanceAfter;
+    bool success = occExecute(&leg, 1, &balanceAfter);
+    
+    logTransaction(clientId, OP_WITHDRAW, success, accountIndex, -1, amount, balanceAfter);
+    return success;
+}
+
+// Function to transfer money optimistically
+bool occTransfer(int clientId, int fromAccountIndex, int toAccountIndex, Money amount) {
+    bool fromFirst = fromAccountIndex < toAccountIndex;
+    Leg legs[2] = { { fromAccountIndex, -amount }, { toAccountIndex, amount } };
+    if (!fromFirst) swap(legs[0], legs[1]);
+    Money balancesAfter[2];
+    bool success = occExecute(legs, 2, balancesAfter);
+    
+    logTransaction(clientId, OP_TRANSFER, success, fromAccountIndex, toAccountIndex, amount,
+                   balancesAfter[fromFirst ? 0 : 1], balancesAfter[fromFirst ? 1 : 0]);
+    return success;
+}
+
+// Function to execute a batch of transfers one optimistic transaction at a time
+int occTransferBatch(int clientId, const TransferRequest* requests, int count, TransferResult* results) {
+    int succeeded = 0;
+    for (int i = 0; i < count; i++) {
+        bool fromFirst = requests[i].fromIndex < requests[i].toIndex;
+        Leg legs[2] = { { requests[i].fromIndex, -requests[i].amount }, 
+                        { requests[i].toIndex, requests[i].amount } };
+        if (!fromFirst) swap(legs[0], legs[1]);
+        Money balancesAfter[2];
+        results[i].success = occExecute(legs, 2, balancesAfter);
+        results[i].refused = false;
+        results[i].fromBalanceAfter = balancesAfter[fromFirst ? 0 : 1];
+        results[i].toBalanceAfter = balancesAfter[fromFirst ? 1 : 0];
+        if (results[i].success) succeeded++;
+        logTransaction(clientId, OP_TRANSFER, results[i].success, requests[i].fromIndex, 
+                       requests[i].toIndex, requests[i].amount, 
+                       results[i].fromBalanceAfter, results[i].toBalanceAfter);
+    }
+    return succeeded;
+}
+
+// Function to pay amount from one account to each payee as one optimistic transaction
+bool occMultiTransfer(int clientId, int payerIndex, const int32_t* payees, int count, Money amount) {
+    thread_local vector<Leg> legs;
+    thread_local vector<Money> balancesAfter;
+    legs.resize(count + 1);
+    balancesAfter.resize(count + 1);
+    int distinct = buildLegs(payerIndex, payees, count, amount, legs.data());
+    bool success = occExecute(legs.data(), distinct, balancesAfter.data());
+    
+    Money payerBalance = 0;
+    for (int k = 0; k < distinct; k++) {
+        if (legs[k].accountIndex == payerIndex) payerBalance = balancesAfter[k];
+    }
+    logTransaction(clientId, OP_MULTI, success, payerIndex, -1, amount * count, payerBalance);
+    return success;
+}
+
+// Function to read a balance kept by the optimistic engine (consistent with its version)
+Money occBalance(int accountIndex) {
+    atomic<uint64_t>& version = accounts.version(accountIndex);
+    while (true) {
+        uint64_t before = version.load(memory_order_acquire);
+        Money balance = accounts.balance(accountIndex).load(memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        if ((before & 1) == 0 && version.load(memory_order_relaxed) == before) return balance;
+    }
+}
+
+// Function to give every account a version word before the optimistic engine runs
+bool startOptimistic() {
+    if (!initAccountVersions(accounts)) {
+        cerr << "Error allocating account versions" << endl;
+        return false;
+    }
+    return true;
+}
+
+// Function to write the latest snapshot to path (through a temporary file, so readers never see half of one)
+bool writeSnapshotFile(const string& path, uint64_t epoch, Money total) {
+    string temporary = path + ".tmp";
+    FILE* out = fopen(temporary.c_str(), "wb");
+    if (out == nullptr) {
+        cerr << "Cannot open snapshot file " << temporary << ": " << strerror(errno) << endl;
+        return false;
+    }
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SNAPSHOT_MAGIC;
+    header.version = SNAPSHOT_VERSION;
+    header.numAccounts = accounts.size();
+    header.epoch = epoch;
+    header.timestamp = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    header.total = total;
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+              fwrite(snapshots.shadow, sizeof(Money), accounts.size(), out) == accounts.size();
+    ok = (fclose(out) == 0) && ok;
+    if (!ok || rename(temporary.c_str(), path.c_str()) != 0) {
+        cerr << "Error writing snapshot file " << path << ": " << strerror(errno) << endl;
+        return false;
+    }
+    return true;
+}
+
+// Function to sum the lock-wait time of every account
+uint64_t totalLockWaitNanos() {
+    uint64_t total = 0;
+    for (int i = 0; i < (int)accounts.size(); i++) {
+        total += accounts.contention[i].waitNanos.load(memory_order_relaxed);
+    }
+    return total;
+}
+
+// Function to cut a new epoch and complete the shadow image; the caller holds cutMutex and
+// may read snapshots.shadow until it releases it. Returns the epoch; total is the image's sum.
+uint64_t cutSnapshot(Money& total) {
+    uint64_t epoch = snapshots.epoch.fetch_add(1, memory_order_acq_rel) + 1;
+    
+    total = 0;
+    for (int i = 0; i < (int)accounts.size(); i++) {
+        lockAccount(i);
+        if (snapshots.versions[i] < epoch) {
+            snapshots.shadow[i] = accounts.balance(i).load(memory_order_relaxed);
+            snapshots.versions[i] = epoch;
+        }
+        total += snapshots.shadow[i];
+        unlockAccount(i);
+    }
+    return epoch;
+}
+
+// Function to take one consistent snapshot while clients keep running
+void takeSnapshot() {
+    pthread_mutex_lock(&snapshots.cutMutex);
+    uint64_t waitBefore = totalLockWaitNanos();
+    uint64_t start = nowNanos();
+    Money total;
+    uint64_t epoch = cutSnapshot(total);
+    uint64_t passNanos = nowNanos() - start;
+    snapshots.lockWaitNanos += totalLockWaitNanos() - waitBefore;
+    
+    if (!snapshots.path.empty()) {
+        uint64_t writeStart = nowNanos();
+        if (!writeSnapshotFile(snapshots.path, epoch, total)) snapshots.failed = true;
+        snapshots.writeNanos += nowNanos() - writeStart;
+    }
+    pthread_mutex_unlock(&snapshots.cutMutex);
+    snapshots.taken++;
+    snapshots.totalNanos += passNanos;
+    snapshots.maxNanos = max(snapshots.maxNanos, passNanos);
+}
+
+// Snapshot thread function: one snapshot per interval until stopped
+void* snapshotThread(void*) {
+    uint64_t next = nowNanos() + snapshots.intervalNanos;
+    while (!snapshots.stopping.load(memory_order_acquire)) {
+        if (nowNanos() < next) {
+            usleep(1000);
+            continue;
+        }
+        takeSnapshot();
+        next = nowNanos() + snapshots.intervalNanos;
+    }
+    return nullptr;
+}
+
+// Function to set up the epoch and shadow arrays for the current account store; from
+// here on the mutex engine copies balances on write
+void enableSnapshotCuts() {
+    if (snapshots.enabled) return;
+    int count = (int)accounts.size();
+    snapshots.versions = new uint64_t[count]();
+    snapshots.shadow = new Money[count]();
+    snapshots.epoch.store(0);
+    snapshots.copies.store(0);
+    pthread_mutex_init(&snapshots.cutMutex, nullptr);
+    snapshots.enabled = true;
+}
+
+// Function to start the periodic snapshot thread
+bool startSnapshots(const string& path, double intervalSeconds) {
+    enableSnapshotCuts();
+    snapshots.path = path;
+    snapshots.intervalNanos = (uint64_t)(intervalSeconds * 1e9);
+    snapshots.taken = 0;
+    snapshots.totalNanos = 0;
+    snapshots.maxNanos = 0;
+    snapshots.writeNanos = 0;
+    snapshots.lockWaitNanos = 0;
+    snapshots.failed = false;
+    snapshots.stopping.store(false);
+    snapshots.periodic = true;
+    if (pthread_create(&snapshots.thread, nullptr, snapshotThread, nullptr) != 0) {
+        cerr << "Error creating snapshot thread" << endl;
+        return false;
+    }
+    return true;
+}
+
+// Function to stop the periodic thread once clients are done; a final snapshot records the end state
+void stopSnapshots() {
+    if (!snapshots.periodic) return;
+    snapshots.stopping.store(true, memory_order_release);
+    pthread_join(snapshots.thread, nullptr);
+    takeSnapshot();
+}
+
+// Function to release snapshot state (after the report)
+void destroySnapshots() {
+    if (!snapshots.enabled) return;
+    delete[] snapshots.versions;
+    delete[] snapshots.shadow;
+    snapshots.versions = nullptr;
+    snapshots.shadow = nullptr;
+    pthread_mutex_destroy(&snapshots.cutMutex);
+    snapshots.enabled = false;
+    snapshots.periodic = false;
+}
+
+// Function to add up the net flow every thread committed before the cut at epoch
+Money auditNetBefore(uint64_t epoch) {
+    pthread_mutex_lock(&audit.registryMutex);
+    vector<AuditLedger*> ledgers = audit.ledgers;
+    pthread_mutex_unlock(&audit.registryMutex);
+    
+    Money net = 0;
+    for (AuditLedger* ledger : ledgers) {
+        if (ledger->epoch.load(memory_order_acquire) >= epoch) {
+            net += ledger->netBefore.load(memory_order_relaxed);
+            continue;
+        }
+        // The thread may cross into the new epoch while we read; net is then past the cut
+        Money value = ledger->net.load(memory_order_acquire);
+        if (ledger->epoch.load(memory_order_acquire) >= epoch) value = ledger->netBefore.load(memory_order_relaxed);
+        net += value;
+    }
+    return net;
+}
+
+// Function to replay the trail entries of the window [fromEpoch, toEpoch) onto the previous
+// image and print the accounts that do not match the current one, with the ids
+// (thread.sequence) of the window's transactions on them
+void reportAuditViolation(uint64_t fromEpoch, uint64_t toEpoch) {
+    pthread_mutex_lock(&audit.registryMutex);
+    vector<AuditLedger*> ledgers = audit.ledgers;
+    pthread_mutex_unlock(&audit.registryMutex);
+    
+    int count = (int)accounts.size();
+    vector<Money> expected(audit.previous, audit.previous + count);
+    vector<pair<uint64_t, int>> touched;        // ((ledger id << 40) | n, account)
+    bool complete = true;
+    
+    for (AuditLedger* ledger : ledgers) {
+        uint64_t end = ledger->count.load(memory_order_acquire);
+        uint64_t begin = ledger->windowStart;
+        if (end - begin > audit.trailCapacity) {
+            complete = false;
+            begin = end - audit.trailCapacity;
+        }
+        for (uint64_t n = begin; n < end; n++) {
+            const AuditTrailEntry& entry = ledger->trail[n & ledger->mask];
+            uint64_t sequence = entry.sequence.load(memory_order_acquire);
+            AuditTrailEntry copy;
+            copy.epoch = entry.epoch;
+            copy.amount = entry.amount;
+            copy.accountIndex = entry.accountIndex;
+            copy.toAccountIndex = entry.toAccountIndex;
+            copy.op = entry.op;
+            atomic_thread_fence(memory_order_acquire);
+            if (sequence != 2 * n + 2 || entry.sequence.load(memory_order_relaxed) != sequence) {
+                complete = false;   // overwritten while we read it
+                continue;
+            }
+            if (copy.epoch < fromEpoch || copy.epoch >= toEpoch) continue;
+            
+            uint64_t txnId = (ledger->id << 40) | n;
+            if (copy.op == OP_DEPOSIT) expected[copy.accountIndex] += copy.amount;
+            else expected[copy.accountIndex] -= copy.amount;
+            touched.push_back(make_pair(txnId, copy.accountIndex));
+            if (copy.op == OP_TRANSFER) {
+                expected[copy.toAccountIndex] += copy.amount;
+                touched.push_back(make_pair(txnId, copy.toAccountIndex));
+            }
+        }
+    }
+    
+    if (!complete) {
+        cerr << "  audit trail wrapped during this window; raise --audit-trail or lower --audit-interval "
+                "to see the transactions involved" << endl;
+        return;
+    }
+    int shown = 0;
+    for (int i = 0; i < count && shown < 10; i++) {
+        if (expected[i] == snapshots.shadow[i]) continue;
+        cerr << "  account=" << accounts.accountNumber(i) << " expected=" << formatMoney(expected[i])
+             << " actual=" << formatMoney(snapshots.shadow[i]) << " txns=";
+        int listed = 0;
+        for (const pair<uint64_t, int>& t : touched) {
+            if (t.second != i) continue;
+            if (listed == 8) {
+                cerr << ",...";
+                break;
+            }
+            cerr << (listed > 0 ? "," : "") << (t.first >> 40) << "." << (t.first & ((1ULL << 40) - 1));
+            listed++;
+        }
+        if (listed == 0) cerr << "none";
+        cerr << endl;
+        shown++;
+    }
+}
+
+// Function to run one audit: cut, check the invariant, report and remember the image
+void runAudit() {
+    pthread_mutex_lock(&snapshots.cutMutex);
+    pthread_mutex_lock(&audit.registryMutex);
+    vector<AuditLedger*> ledgers = audit.ledgers;
+    pthread_mutex_unlock(&audit.registryMutex);
+    vector<uint64_t> counts;
+    for (AuditLedger* ledger : ledgers) counts.push_back(ledger->count.load(memory_order_acquire));
+    
+    uint64_t start = nowNanos();
+    Money total;
+    uint64_t epoch = cutSnapshot(total);
+    Money expected = audit.openingTotal + auditNetBefore(epoch);
+    uint64_t elapsed = nowNanos() - start;
+    
+    if (total != expected + audit.drift) {
+        audit.violations++;
+        cerr << "AUDIT VIOLATION epoch=" << epoch << " total_balance=" << formatMoney(total)
+             << " expected_balance=" << formatMoney(expected) 
+             << " new_difference=" << formatMoney(total - expected - audit.drift) << endl;
+        reportAuditViolation(audit.previousEpoch, epoch);
+        audit.drift = total - expected;
+    }
+    
+    memcpy(audit.previous, snapshots.shadow, accounts.size() * sizeof(Money));
+    audit.previousEpoch = epoch;
+    for (size_t k = 0; k < ledgers.size(); k++) ledgers[k]->windowStart = counts[k];
+    pthread_mutex_unlock(&snapshots.cutMutex);
+    
+    audit.audits++;
+    audit.totalNanos += elapsed;
+    audit.maxNanos = max(audit.maxNanos, elapsed);
+}
+
+// Auditor thread function: one audit per interval until stopped
+void* auditorThread(void*) {
+    uint64_t next = nowNanos() + audit.intervalNanos;
+    while (!audit.stopping.load(memory_order_acquire)) {
+        if (nowNanos() < next) {
+            usleep(1000);
+            continue;
+        }
+        runAudit();
+        next = nowNanos() + audit.intervalNanos;
+    }
+    return nullptr;
+}
+
+// Function to start the auditor; openingTotal is the sum of all balances before clients start
+bool startAuditor(double intervalSeconds, uint64_t trailCapacity, Money openingTotal) {
+    enableSnapshotCuts();
+    audit.trailCapacity = trailCapacity;
+    audit.openingTotal = openingTotal;
+    audit.drift = 0;
+    audit.intervalNanos = (uint64_t)(intervalSeconds * 1e9);
+    audit.previous = new Money[accounts.size()];
+    for (int i = 0; i < (int)accounts.size(); i++) {
+        audit.previous[i] = accounts.balance(i).load(memory_order_relaxed);
+    }
+    audit.previousEpoch = snapshots.epoch.load();
+    audit.audits = 0;
+    audit.totalNanos = 0;
+    audit.maxNanos = 0;
+    audit.violations = 0;
+    pthread_mutex_init(&audit.registryMutex, nullptr);
+    audit.stopping.store(false);
+    audit.enabled = true;
+    if (pthread_create(&audit.thread, nullptr, auditorThread, nullptr) != 0) {
+        cerr << "Error creating auditor thread" << endl;
+        return false;
+    }
+    return true;
+}
+
+// Function to stop the auditor once clients are done; a final audit covers the tail of the run
+void stopAuditor() {
+    if (!audit.enabled) return;
+    audit.stopping.store(true, memory_order_release);
+    pthread_join(audit.thread, nullptr);
+    runAudit();
+}
+
+// Function to release the auditor's ledgers (after the report)
+void destroyAuditor() {
+    if (!audit.enabled) return;
+    for (AuditLedger* ledger : audit.ledgers) {
+        delete[] ledger->trail;
+        delete ledger;
+    }
+    audit.ledgers.clear();
+    delete[] audit.previous;
+    pthread_mutex_destroy(&audit.registryMutex);
+    audit.enabled = false;
+}
+
+// Function to read a snapshot file's header; returns false if it is not a valid snapshot
+bool readSnapshotHeader(const string& path, SnapshotHeader& header) {
+    FILE* in = fopen(path.c_str(), "rb");
+    if (in == nullptr) {
+        cerr << "Cannot open snapshot " << path << ": " << strerror(errno) << endl;
+        return false;
+    }
+    bool ok = fread(&header, sizeof(header), 1, in) == 1 && 
+              header.magic == SNAPSHOT_MAGIC && header.version == SNAPSHOT_VERSION &&
+              header.numAccounts > 0 && header.numAccounts <= INT_MAX;
+    fclose(in);
+    if (!ok) cerr << "Snapshot " << path << " has an unrecognized header" << endl;
+    return ok;
+}
+
+// Function to load every balance from a snapshot file into the (already sized) account store
+bool loadSnapshot(const string& path) {
+    FILE* in = fopen(path.c_str(), "rb");
+    if (in == nullptr) {
+        cerr << "Cannot open snapshot " << path << ": " << strerror(errno) << endl;
+        return false;
+    }
+    SnapshotHeader header;
+    bool ok = fread(&header, sizeof(header), 1, in) == 1 && header.numAccounts == (int64_t)accounts.size();
+    
+    vector<Money> balances(accounts.size());
+    ok = ok && fread(balances.data(), sizeof(Money), balances.size(), in) == balances.size();
+    fclose(in);
+    
+    Money total = 0;
+    for (int i = 0; ok && i < (int)accounts.size(); i++) {
+        accounts.balance(i).store(balances[i], memory_order_relaxed);
+        total += balances[i];
+    }
+    if (!ok || total != header.total) {
+        cerr << "Snapshot " << path << " is truncated or corrupt" << endl;
+        return false;
+    }
+    return true;
+}
+
+// Balance engines selectable at runtime, in EngineType order
+const Engine ENGINES[ENGINE_COUNT] = {
+    { "mutex",      deposit,        withdraw,        transfer,        transferBatch,        
+                    multiTransfer,    mutexBalance,   nullptr,         nullptr },
+    { "atomic",     atomicDeposit,  atomicWithdraw,  atomicTransfer,  atomicTransferBatch,  
+                    nullptr,          atomicBalance,  nullptr,         nullptr },
+    { "sharded",    shardedDeposit, shardedWithdraw, shardedTransfer, shardedTransferBatch, 
+                    nullptr,          shardedBalance, startShards,     stopShards },
+    { "optimistic", occDeposit,     occWithdraw,     occTransfer,     occTransferBatch,     
+                    occMultiTransfer, occBalance,     startOptimistic, nullptr }
+};
+
+const Engine* engine = &ENGINES[ENGINE_MUTEX];
+
+// Function to read a balance on the configured engine and log the inquiry
+bool balanceInquiry(int clientId, int accountIndex) {
+    Money balance = engine->balance(accountIndex);
+    logTransaction(clientId, OP_BALANCE_INQUIRY, true, accountIndex, -1, 0, balance);
+    return true;
+}
+
+FILE* bankJournalOut = nullptr;     // journal opened by openBank()
+
+// Function to set up the accounts, history, journal and engine for cfg without starting any clients
+// (what the benchmarks and other library users start from; closeBank() undoes it)
+bool openBank(const Config& cfg) {
+    config = cfg;
+    engine = &ENGINES[config.engine];
+    history.enabled = config.recordHistory;
+    if (!initAccountStore(accounts, config.numAccounts, config.initialBalance, 
+                          (AccountLayout)config.accountLayout, (AccountNumbering)config.accountNumbering,
+                          (LockPolicy)config.lockPolicy)) {
+        cerr << "Error allocating " << config.numAccounts << " accounts" << endl;
+        return false;
+    }
+    if (!config.journalPath.empty()) {
+        bankJournalOut = (config.journalPath == "-") ? stdout : fopen(config.journalPath.c_str(), "wb");
+        if (bankJournalOut == nullptr) {
+            cerr << "Cannot open journal " << config.journalPath << ": " << strerror(errno) << endl;
+            return false;
+        }
+        if (!startJournal(bankJournalOut, (JournalFormat)config.journalFormat, 
+                          (JournalPolicy)config.journalPolicy, config.journalCapacity)) {
+            cerr << "Error creating journal writer thread" << endl;
+            return false;
+        }
+    }
+    return engine->start == nullptr || engine->start();
+}
+
+// Function to stop the engine and journal and release the accounts set up by openBank()
+void closeBank() {
+    if (engine->stop != nullptr) engine->stop();
+    stopJournal();
+    if (bankJournalOut != nullptr && bankJournalOut != stdout) fclose(bankJournalOut);
+    bankJournalOut = nullptr;
+    destroyAccountStore(accounts);
+    clearHistory();
+    clearOccStats();
+}
+
+// Function to get the headless defaults (what the command line starts from)
+Config defaultHeadlessConfig() {
+    Config cfg;
+    cfg.numAccounts = 1000;
+    cfg.initialBalance = 1000 * CENTS_PER_DOLLAR;
+    cfg.numClients = 8;
+    cfg.transactionsPerClient = 100000;
+    cfg.minAmount = 1 * CENTS_PER_DOLLAR;
+    cfg.maxAmount = 100 * CENTS_PER_DOLLAR;
+    cfg.headless = true;
+    for (int op = 0; op < OP_COUNT; op++) cfg.opWeights[op] = 1;
+    cfg.opWeights[OP_MULTI] = 0;
+    cfg.opWeights[OP_BALANCE_INQUIRY] = 0;
+    cfg.seed = (unsigned int)time(nullptr);
+    cfg.durationSeconds = 0;
+    cfg.journalPath = "";
+    cfg.journalFormat = JOURNAL_TEXT;
+    cfg.journalPolicy = JOURNAL_BLOCK;
+    cfg.journalCapacity = 65536;
+    cfg.accountLayout = LAYOUT_PADDED;
+    cfg.accountNumbering = ACCOUNT_NUMBERS_SEQUENTIAL;
+    cfg.indexBenchmark = false;
+    cfg.engine = ENGINE_MUTEX;
+    cfg.lockPolicy = LOCK_MUTEX;
+    cfg.recordHistory = false;
+    cfg.workers = 0;
+    cfg.pregenerate = false;
+    cfg.distribution = DIST_UNIFORM;
+    cfg.zipfTheta = 0.99;
+    cfg.hotspotAccountsPercent = 1;
+    cfg.hotspotOpsPercent = 90;
+    cfg.batchSize = 0;
+    cfg.shards = (int)max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+    cfg.multiLegs = 16;
+    cfg.walPath = "";
+    cfg.recoverPath = "";
+    cfg.walIntervalMicros = 1000;
+    cfg.walBatch = 0;
+    cfg.walCapacity = 0;
+    cfg.walSync = false;
+    cfg.snapshotPath = "";
+    cfg.snapshotIntervalSeconds = 1;
+    cfg.loadSnapshotPath = "";
+    cfg.audit = false;
+    cfg.auditIntervalSeconds = 0.1;
+    cfg.auditTrailCapacity = 65536;
+    cfg.metricsPath = "";
+    cfg.metricsFormat = METRICS_JSON;
+    cfg.metricsIntervalSeconds = 1;
+    cfg.replayPath = "";
+    cfg.replaySpeed = 0;
+    return cfg;
+}
@@ -8,74 +8,155 @@
 #include <sstream>
 #include <fstream>
 #include <limits>
+#include <cstdint>
+#include <cmath>
+#include <climits>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <unordered_map>
+#include <atomic>
+#include <sched.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "bank_simulator.h"
 
 using namespace std;
 
-// ANSI Color Codes for beautiful terminal output
-namespace Colors {
-    const string RESET = "\033[0m";
-    const string BOLD = "\033[1m";
-    const string DIM = "\033[2m";
-    
-    // Text Colors
-    const string RED = "\033[31m";
-    const string GREEN = "\033[32m";
-    const string YELLOW = "\033[33m";
-    const string BLUE = "\033[34m";
-    const string MAGENTA = "\033[35m";
-    const string CYAN = "\033[36m";
-    const string WHITE = "\033[37m";
-    
-    // Background Colors
-    const string BG_BLUE = "\033[44m";
-    const string BG_GREEN = "\033[42m";
-    const string BG_YELLOW = "\033[43m";
-    const string BG_RED = "\033[41m";
-    const string BG_CYAN = "\033[46m";
-    
-    // Bright Colors
-    const string BRIGHT_GREEN = "\033[92m";
-    const string BRIGHT_YELLOW = "\033[93m";
-    const string BRIGHT_BLUE = "\033[94m";
-    const string BRIGHT_MAGENTA = "\033[95m";
-    const string BRIGHT_CYAN = "\033[96m";
-}
-
-// Configuration structure
-struct Config {
-    int numAccounts;
-    double initialBalance;
-    int numClients;
-    int transactionsPerClient;
-    double minAmount;
-    double maxAmount;
-};
+pthread_mutex_t progressMutex = PTHREAD_MUTEX_INITIALIZER;
 
-// Transaction record structure
-struct Transaction {
-    int clientId;
-    int accountNumber;
-    string type;  // "DEPOSIT" or "WITHDRAW" or "TRANSFER"
-    double amount;
-    double balanceAfter;
-    time_t timestamp;
+// Log-linear latency histogram (HDR style): values below 2^SUB_BUCKET_BITS are
+// recorded exactly, larger values keep SUB_BUCKET_BITS significant bits (~3% error).
+struct LatencyHistogram {
+    static const int SUB_BUCKET_BITS = 6;
+    static const int SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+    static const int HALF_SUB_BUCKET_COUNT = SUB_BUCKET_COUNT / 2;
+    static const int BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * HALF_SUB_BUCKET_COUNT + HALF_SUB_BUCKET_COUNT;
+    
+    // One thread records, any thread may read or merge at any time: every word is a
+    // relaxed atomic updated with a plain load and store, so recording costs no more
+    // than before and readers see each counter whole (possibly a little behind)
+    atomic<uint64_t> counts[BUCKET_COUNT];
+    atomic<uint64_t> totalCount;
+    atomic<uint64_t> maxValue;
+    
+    LatencyHistogram() { reset(); }
+    
+    void reset() {
+        for (int i = 0; i < BUCKET_COUNT; i++) counts[i].store(0, memory_order_relaxed);
+        totalCount.store(0, memory_order_relaxed);
+        maxValue.store(0, memory_order_relaxed);
+    }
+    
+    static void bump(atomic<uint64_t>& counter, uint64_t amount) {
+        counter.store(counter.load(memory_order_relaxed) + amount, memory_order_relaxed);
+    }
+    
+    static int bucketIndex(uint64_t value) {
+        if (value < (uint64_t)SUB_BUCKET_COUNT) return (int)value;
+        int magnitude = (63 - __builtin_clzll(value)) - (SUB_BUCKET_BITS - 1);
+        return magnitude * HALF_SUB_BUCKET_COUNT + (int)(value >> magnitude);
+    }
+    
+    // Representative (midpoint) value of a bucket
+    static uint64_t bucketValue(int index) {
+        if (index < SUB_BUCKET_COUNT) return (uint64_t)index;
+        int magnitude = index / HALF_SUB_BUCKET_COUNT - 1;
+        uint64_t subBucket = (uint64_t)(index - magnitude * HALF_SUB_BUCKET_COUNT);
+        return (subBucket << magnitude) + ((1ULL << magnitude) >> 1);
+    }
+    
+    void record(uint64_t value) {
+        bump(counts[bucketIndex(value)], 1);
+        bump(totalCount, 1);
+        if (value > maxValue.load(memory_order_relaxed)) maxValue.store(value, memory_order_relaxed);
+    }
+    
+    // The total is recomputed from the buckets, so merging a histogram that is still
+    // being recorded gives a self-consistent result
+    void merge(const LatencyHistogram& other) {
+        uint64_t added = 0;
+        for (int i = 0; i < BUCKET_COUNT; i++) {
+            uint64_t count = other.counts[i].load(memory_order_relaxed);
+            bump(counts[i], count);
+            added += count;
+        }
+        bump(totalCount, added);
+        if (other.maxValue.load(memory_order_relaxed) > maxValue.load(memory_order_relaxed)) {
+            maxValue.store(other.maxValue.load(memory_order_relaxed), memory_order_relaxed);
+        }
+    }
+    
+    // Function to keep only what was recorded since earlier (a previous merge of the same sources);
+    // the maximum stays the all-time maximum
+    void subtract(const LatencyHistogram& earlier) {
+        uint64_t remaining = 0;
+        for (int i = 0; i < BUCKET_COUNT; i++) {
+            uint64_t count = counts[i].load(memory_order_relaxed) - earlier.counts[i].load(memory_order_relaxed);
+            counts[i].store(count, memory_order_relaxed);
+            remaining += count;
+        }
+        totalCount.store(remaining, memory_order_relaxed);
+    }
+    
+    uint64_t count() const { return totalCount.load(memory_order_relaxed); }
+    uint64_t maximum() const { return maxValue.load(memory_order_relaxed); }
+    
+    uint64_t percentile(double p) const {
+        uint64_t total = count();
+        if (total == 0) return 0;
+        uint64_t target = (uint64_t)(p / 100.0 * total + 0.5);
+        if (target == 0) target = 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKET_COUNT; i++) {
+            seen += counts[i].load(memory_order_relaxed);
+            if (seen >= target) return min(bucketValue(i), maximum());
+        }
+        return maximum();
+    }
 };
 
-// Bank Account structure
-struct BankAccount {
-    int accountNumber;
-    double balance;
-    pthread_mutex_t lock;
-    vector<Transaction> transactionHistory;
+// Per-thread benchmark statistics: one latency histogram per operation and outcome, whose
+// counts double as the operation counters. The metrics dumper merges them while clients run;
+// the report merges them after all threads have joined.
+struct ClientStats {
+    LatencyHistogram latency[OP_COUNT][OUTCOME_COUNT];
+    Money deposited;
+    Money withdrawn;
+    uint64_t transferBatches;       // --batch: batches executed and the transfers they carried
+    uint64_t batchedTransfers;
+    
+    ClientStats() : deposited(0), withdrawn(0), transferBatches(0), batchedTransfers(0) {}
+    
+    void record(int op, bool success, uint64_t nanos, bool refused = false) {
+        latency[op][outcomeOf(op, success, refused)].record(nanos);
+    }
+    
+    uint64_t succeeded(int op) const { return latency[op][OUTCOME_OK].count(); }
+    uint64_t failed(int op) const {
+        uint64_t total = 0;
+        for (int outcome = OUTCOME_OK + 1; outcome < OUTCOME_COUNT; outcome++) total += latency[op][outcome].count();
+        return total;
+    }
+    
+    // Histograms only: safe while the other thread is still recording
+    void mergeLatency(const ClientStats& other) {
+        for (int op = 0; op < OP_COUNT; op++) {
+            for (int outcome = 0; outcome < OUTCOME_COUNT; outcome++) latency[op][outcome].merge(other.latency[op][outcome]);
+        }
+    }
+    
+    void merge(const ClientStats& other) {
+        mergeLatency(other);
+        deposited += other.deposited;
+        withdrawn += other.withdrawn;
+        transferBatches += other.transferBatches;
+        batchedTransfers += other.batchedTransfers;
+    }
 };
 
-// Global variables
-vector<BankAccount> accounts;
-pthread_mutex_t logMutex = PTHREAD_MUTEX_INITIALIZER;
-Config config;
-int totalTransactionsCompleted = 0;
-pthread_mutex_t progressMutex = PTHREAD_MUTEX_INITIALIZER;
-
 // Function to clear screen (works on Linux/Unix)
 void clearScreen() {
     cout << "\033[2J\033[H";
@@ -143,304 +224,1964 @@ double getDoubleInput(const string& prompt, double min = 0.01) {
 
 // Function to get user configuration
 Config getUserConfig() {
-    Config cfg;
+    Config cfg = defaultHeadlessConfig();
     
     printHeader();
     cout << Colors::BRIGHT_MAGENTA << Colors::BOLD << "\n📋 CONFIGURATION SETUP\n" << Colors::RESET;
     printSeparator("Please provide the following information");
     cout << endl;
     
-    cfg.numAccounts = getIntInput("Number of Bank Accounts (1-10): ", 1, 10);
-    cfg.initialBalance = getDoubleInput("Initial Balance per Account ($): ", 0.01);
-    cfg.numClients = getIntInput("Number of Client Threads (1-20): ", 1, 20);
-    cfg.transactionsPerClient = getIntInput("Transactions per Client (1-50): ", 1, 50);
-    cfg.minAmount = getDoubleInput("Minimum Transaction Amount ($): ", 0.01);
-    cfg.maxAmount = getDoubleInput("Maximum Transaction Amount ($): ", cfg.minAmount);
+    cfg.numAccounts = getIntInput("Number of Bank Accounts: ", 1, INT_MAX);
+    cfg.initialBalance = toMoney(getDoubleInput("Initial Balance per Account ($): ", 0.01));
+    cfg.numClients = getIntInput("Number of Client Threads: ", 1, INT_MAX);
+    cfg.transactionsPerClient = getIntInput("Transactions per Client: ", 1, INT_MAX);
+    double minAmount = getDoubleInput("Minimum Transaction Amount ($): ", 0.01);
+    cfg.minAmount = toMoney(minAmount);
+    cfg.maxAmount = toMoney(getDoubleInput("Maximum Transaction Amount ($): ", minAmount));
+    
+    // Everything else keeps the headless defaults; interactive runs show a live colored
+    // log, keep per-account history and run the sharded engine on one shard
+    cfg.headless = false;
+    cfg.journalPath = "-";
+    cfg.journalFormat = JOURNAL_TEXT_COLOR;
+    cfg.journalCapacity = 4096;
+    cfg.recordHistory = true;
+    cfg.shards = 1;
     
     return cfg;
 }
 
-// Function to log transaction with beautiful formatting
-void logTransaction(int clientId, int accountNumber, const string& type, 
-                    double amount, double balanceAfter) {
-    pthread_mutex_lock(&logMutex);
-    
-    Transaction trans;
-    trans.clientId = clientId;
-    trans.accountNumber = accountNumber;
-    trans.type = type;
-    trans.amount = amount;
-    trans.balanceAfter = balanceAfter;
-    trans.timestamp = time(nullptr);
-    
-    // Add to account history
-    for (auto& acc : accounts) {
-        if (acc.accountNumber == accountNumber) {
-            acc.transactionHistory.push_back(trans);
-            break;
-        }
-    }
-    
-    // Update progress
-    totalTransactionsCompleted++;
-    int totalTransactions = config.numClients * config.transactionsPerClient;
-    int progress = (totalTransactionsCompleted * 100) / totalTransactions;
-    
-    // Print transaction with colors
-    time_t now = time(nullptr);
-    tm* localTime = localtime(&now);
-    
-    // Choose color based on transaction type
-    string typeColor;
-    string icon;
-    if (type.find("DEPOSIT") != string::npos) {
-        typeColor = Colors::GREEN;
-        icon = "💰";
-    } else if (type.find("WITHDRAW") != string::npos) {
-        typeColor = Colors::YELLOW;
-        icon = "💸";
-    } else {
-        typeColor = Colors::BLUE;
-        icon = "🔄";
+// ---------------------------------------------------------------------------
+// Metrics dump: clients already record every operation into their own
+// ClientStats histograms, so they share nothing. A dumper thread merges
+// them every --metrics-interval seconds. It subtracts the previous merge to
+// get the interval's ops/sec and latency percentiles per operation and
+// outcome, and adds the lock-wait time summed from the per-account
+// contention counters. Each dump is one JSON line appended to the file, or a
+// Prometheus text exposition that replaces the file (textfile collector
+// style). The registry mutex is taken once per client thread, never per
+// operation.
+// ---------------------------------------------------------------------------
+
+struct MetricsState {
+    bool enabled;
+    string path;
+    MetricsFormat format;
+    uint64_t intervalNanos;
+    pthread_mutex_t registryMutex;  // guards sources; taken once per client thread or worker
+    vector<ClientStats*> sources;
+    atomic<bool> stopping;
+    pthread_t thread;
+    FILE* out;                      // JSON lines file
+    // Written by the dumper thread only
+    ClientStats* previous;          // merge at the previous dump
+    uint64_t startNanos;
+    uint64_t previousNanos;
+    uint64_t previousLockWait;
+    uint64_t dumps;
+    bool failed;
+};
+
+MetricsState metrics;
+
+const double METRIC_PERCENTILES[] = { 50.0, 90.0, 99.0, 99.9 };
+const char* const METRIC_PERCENTILE_NAMES[] = { "p50_ns", "p90_ns", "p99_ns", "p999_ns" };
+const char* const METRIC_QUANTILES[] = { "0.5", "0.9", "0.99", "0.999" };
+const int METRIC_PERCENTILE_COUNT = 4;
+
+// Function to let the dumper see a thread's statistics (call before the thread starts)
+void registerMetricsSource(ClientStats* stats) {
+    if (!metrics.enabled) return;
+    pthread_mutex_lock(&metrics.registryMutex);
+    metrics.sources.push_back(stats);
+    pthread_mutex_unlock(&metrics.registryMutex);
+}
+
+// Function to write one JSON line: cumulative counts, interval rates and percentiles
+void formatMetricsJson(ostringstream& out, const ClientStats& current, LatencyHistogram (*interval)[OUTCOME_COUNT],
+                       double seconds, double intervalSeconds, uint64_t ops, uint64_t intervalOps, uint64_t lockWait) {
+    out << fixed << setprecision(3)
+        << "{\"time_s\":" << seconds << ",\"ops\":" << ops
+        << ",\"ops_per_sec\":" << setprecision(0) << intervalOps / intervalSeconds
+        << ",\"lock_wait_ms\":" << setprecision(3) << lockWait / 1e6
+        << ",\"lock_wait_ms_per_s\":" << (lockWait - metrics.previousLockWait) / 1e6 / intervalSeconds
+        << ",\"operations\":[";
+    bool first = true;
+    for (int op = 0; op < OP_COUNT; op++) {
+        for (int outcome = 0; outcome < OUTCOME_COUNT; outcome++) {
+            const LatencyHistogram& h = current.latency[op][outcome];
+            if (h.count() == 0) continue;
+            out << (first ? "" : ",") << "{\"op\":\"" << OP_NAMES[op] << "\",\"outcome\":\"" 
+                << OUTCOME_NAMES[outcome] << "\",\"count\":" << h.count()
+                << ",\"interval_count\":" << interval[op][outcome].count();
+            for (int p = 0; p < METRIC_PERCENTILE_COUNT; p++) {
+                out << ",\"" << METRIC_PERCENTILE_NAMES[p] << "\":" << interval[op][outcome].percentile(METRIC_PERCENTILES[p]);
+            }
+            out << ",\"max_ns\":" << h.maximum() << "}";
+            first = false;
+        }
+    }
+    out << "]}\n";
+}
+
+// Function to write a Prometheus text exposition of the same figures
+void formatMetricsPrometheus(ostringstream& out, const ClientStats& current, LatencyHistogram (*interval)[OUTCOME_COUNT],
+                             double intervalSeconds, uint64_t intervalOps, uint64_t lockWait) {
+    out << "# HELP bank_operations_total Operations finished, by type and outcome.\n"
+        << "# TYPE bank_operations_total counter\n";
+    for (int op = 0; op < OP_COUNT; op++) {
+        for (int outcome = 0; outcome < OUTCOME_COUNT; outcome++) {
+            if (current.latency[op][outcome].count() == 0) continue;
+            out << "bank_operations_total{op=\"" << OP_NAMES[op] << "\",outcome=\"" << OUTCOME_NAMES[outcome]
+                << "\"} " << current.latency[op][outcome].count() << "\n";
+        }
+    }
+    out << "# HELP bank_operation_latency_ns Operation latency over the last interval.\n"
+        << "# TYPE bank_operation_latency_ns summary\n";
+    for (int op = 0; op < OP_COUNT; op++) {
+        for (int outcome = 0; outcome < OUTCOME_COUNT; outcome++) {
+            if (current.latency[op][outcome].count() == 0) continue;
+            for (int p = 0; p < METRIC_PERCENTILE_COUNT; p++) {
+                out << "bank_operation_latency_ns{op=\"" << OP_NAMES[op] << "\",outcome=\"" << OUTCOME_NAMES[outcome]
+                    << "\",quantile=\"" << METRIC_QUANTILES[p] << "\"} " 
+                    << interval[op][outcome].percentile(METRIC_PERCENTILES[p]) << "\n";
+            }
+            out << "bank_operation_latency_ns_count{op=\"" << OP_NAMES[op] << "\",outcome=\"" << OUTCOME_NAMES[outcome]
+                << "\"} " << current.latency[op][outcome].count() << "\n";
+        }
     }
+    out << fixed << setprecision(0)
+        << "# HELP bank_ops_per_second Operations per second over the last interval.\n"
+        << "# TYPE bank_ops_per_second gauge\n"
+        << "bank_ops_per_second " << intervalOps / intervalSeconds << "\n"
+        << setprecision(6)
+        << "# HELP bank_lock_wait_seconds_total Time clients spent waiting for account locks.\n"
+        << "# TYPE bank_lock_wait_seconds_total counter\n"
+        << "bank_lock_wait_seconds_total " << lockWait / 1e9 << "\n";
+}
+
+// Function to merge every thread's statistics and write one dump
+void dumpMetrics() {
+    uint64_t now = nowNanos();
+    ClientStats* current = new ClientStats();
+    pthread_mutex_lock(&metrics.registryMutex);
+    for (ClientStats* stats : metrics.sources) current->mergeLatency(*stats);
+    pthread_mutex_unlock(&metrics.registryMutex);
+    uint64_t lockWait = totalLockWaitNanos();
     
-    cout << Colors::DIM << "[" << put_time(localTime, "%H:%M:%S") << "]" << Colors::RESET << " "
-         << Colors::BRIGHT_CYAN << "Client " << setw(2) << clientId << Colors::RESET << " | "
-         << typeColor << icon << " " << type << Colors::RESET
-         << " $" << Colors::BOLD << setw(10) << fixed << setprecision(2) << amount << Colors::RESET
-         << " | " << Colors::MAGENTA << "Account " << accountNumber << Colors::RESET
-         << " | " << Colors::BRIGHT_GREEN << "Balance: $" << setw(12) << fixed << setprecision(2) 
-         << balanceAfter << Colors::RESET
-         << " [" << Colors::BRIGHT_YELLOW << progress << "%" << Colors::RESET << "]" << endl;
+    static LatencyHistogram interval[OP_COUNT][OUTCOME_COUNT];
+    uint64_t ops = 0, intervalOps = 0;
+    for (int op = 0; op < OP_COUNT; op++) {
+        for (int outcome = 0; outcome < OUTCOME_COUNT; outcome++) {
+            interval[op][outcome].reset();
+            interval[op][outcome].merge(current->latency[op][outcome]);
+            interval[op][outcome].subtract(metrics.previous->latency[op][outcome]);
+            ops += current->latency[op][outcome].count();
+            intervalOps += interval[op][outcome].count();
+        }
+    }
+    double seconds = (now - metrics.startNanos) / 1e9;
+    double intervalSeconds = max(now - metrics.previousNanos, (uint64_t)1) / 1e9;
+    
+    ostringstream text;
+    if (metrics.format == METRICS_JSON) {
+        formatMetricsJson(text, *current, interval, seconds, intervalSeconds, ops, intervalOps, lockWait);
+        string line = text.str();
+        if (fwrite(line.data(), 1, line.size(), metrics.out) != line.size() || fflush(metrics.out) != 0) {
+            metrics.failed = true;
+        }
+    } else {
+        formatMetricsPrometheus(text, *current, interval, intervalSeconds, intervalOps, lockWait);
+        string exposition = text.str();
+        string temporary = metrics.path + ".tmp";
+        FILE* out = fopen(temporary.c_str(), "w");
+        bool ok = out != nullptr && fwrite(exposition.data(), 1, exposition.size(), out) == exposition.size();
+        if (out != nullptr) ok = (fclose(out) == 0) && ok;
+        if (!ok || rename(temporary.c_str(), metrics.path.c_str()) != 0) metrics.failed = true;
+    }
     
-    pthread_mutex_unlock(&logMutex);
+    delete metrics.previous;
+    metrics.previous = current;
+    metrics.previousNanos = now;
+    metrics.previousLockWait = lockWait;
+    metrics.dumps++;
+}
+
+// Metrics thread function: one dump per interval until stopped
+void* metricsThread(void*) {
+    uint64_t next = nowNanos() + metrics.intervalNanos;
+    while (!metrics.stopping.load(memory_order_acquire)) {
+        if (nowNanos() < next) {
+            usleep(1000);
+            continue;
+        }
+        dumpMetrics();
+        next = nowNanos() + metrics.intervalNanos;
+    }
+    return nullptr;
+}
+
+// Function to start the metrics dumper (before any client thread starts)
+bool startMetrics(const string& path, MetricsFormat format, double intervalSeconds) {
+    metrics.path = path;
+    metrics.format = format;
+    metrics.intervalNanos = (uint64_t)(intervalSeconds * 1e9);
+    metrics.out = nullptr;
+    if (format == METRICS_JSON) {
+        metrics.out = fopen(path.c_str(), "w");
+        if (metrics.out == nullptr) {
+            cerr << "Cannot open metrics file " << path << ": " << strerror(errno) << endl;
+            return false;
+        }
+    }
+    metrics.previous = new ClientStats();
+    metrics.startNanos = nowNanos();
+    metrics.previousNanos = metrics.startNanos;
+    metrics.previousLockWait = totalLockWaitNanos();
+    metrics.dumps = 0;
+    metrics.failed = false;
+    pthread_mutex_init(&metrics.registryMutex, nullptr);
+    metrics.stopping.store(false);
+    metrics.enabled = true;
+    if (pthread_create(&metrics.thread, nullptr, metricsThread, nullptr) != 0) {
+        cerr << "Error creating metrics thread" << endl;
+        return false;
+    }
+    return true;
+}
+
+// Function to stop the dumper once clients are done; a final dump covers the tail of the run
+void stopMetrics() {
+    if (!metrics.enabled) return;
+    metrics.stopping.store(true, memory_order_release);
+    pthread_join(metrics.thread, nullptr);
+    dumpMetrics();
+    if (metrics.out != nullptr) fclose(metrics.out);
+    delete metrics.previous;
+    metrics.sources.clear();
+    pthread_mutex_destroy(&metrics.registryMutex);
+    metrics.enabled = false;
 }
 
-// Function to deposit money
-bool deposit(int clientId, int accountIndex, double amount) {
-    pthread_mutex_lock(&accounts[accountIndex].lock);
+// ---------------------------------------------------------------------------
+// Workload generation
+//
+// Every client owns a xoshiro256** generator seeded from (seed, clientId)
+// through splitmix64, so there is no shared generator state between threads
+// and each client's operation stream depends only on the seed. With --pregen
+// the streams are generated into one contiguous buffer before the timed phase.
+// ---------------------------------------------------------------------------
+
+// Function to advance a splitmix64 state (used only for seeding)
+uint64_t splitmix64(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// xoshiro256** pseudo-random generator
+struct Xoshiro256 {
+    uint64_t s[4];
     
-    accounts[accountIndex].balance += amount;
-    double newBalance = accounts[accountIndex].balance;
+    void seed(uint64_t seedValue, uint64_t stream) {
+        uint64_t state = seedValue ^ (stream * 0xD1B54A32D192ED03ULL);
+        for (int i = 0; i < 4; i++) s[i] = splitmix64(state);
+    }
     
-    pthread_mutex_unlock(&accounts[accountIndex].lock);
+    static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
     
-    logTransaction(clientId, accounts[accountIndex].accountNumber, 
-                   "DEPOSIT  ", amount, newBalance);
+    uint64_t next() {
+        uint64_t result = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+    
+    // Uniform value in [0, bound) (multiply-shift, bound must be > 0)
+    uint64_t uniform(uint64_t bound) {
+        return (uint64_t)(((unsigned __int128)next() * bound) >> 64);
+    }
+};
+
+// Account picker shared by all clients; precomputed once, read-only during the run.
+// Hot accounts are the lowest indexes, so they show up first in reports.
+struct AccountPicker {
+    AccountDistribution type;
+    uint64_t count;
+    
+    // Zipfian generator of Gray et al. (as used by YCSB), 0 < theta < 1
+    double theta;
+    double zetan;
+    double alpha;
+    double eta;
+    double zipfSecondThreshold;   // 1 + 0.5^theta
+    
+    // Hotspot: picks below hotThreshold (out of 2^64) go to the first hotCount accounts
+    uint64_t hotCount;
+    uint64_t hotThreshold;
+};
+
+AccountPicker accountPicker;
+
+// Function to precompute the account picker for the configured distribution
+void initAccountPicker(AccountPicker& picker, uint64_t count) {
+    picker.type = (AccountDistribution)config.distribution;
+    picker.count = count;
+    
+    if (picker.type == DIST_ZIPF) {
+        double theta = config.zipfTheta;
+        double zetan = 0;
+        for (uint64_t i = 1; i <= count; i++) zetan += 1.0 / pow((double)i, theta);
+        double zeta2 = 1.0 + pow(0.5, theta);
+        picker.theta = theta;
+        picker.zetan = zetan;
+        picker.alpha = 1.0 / (1.0 - theta);
+        picker.eta = (1.0 - pow(2.0 / count, 1.0 - theta)) / (1.0 - zeta2 / zetan);
+        picker.zipfSecondThreshold = zeta2;
+    } else if (picker.type == DIST_HOTSPOT) {
+        picker.hotCount = max<uint64_t>(1, (uint64_t)(count * config.hotspotAccountsPercent / 100.0));
+        double share = config.hotspotOpsPercent / 100.0;
+        picker.hotThreshold = share >= 1.0 ? UINT64_MAX : (uint64_t)(share * 18446744073709551616.0);
+    }
+}
+
+// Function to pick an account index according to the configured distribution
+uint64_t pickAccount(const AccountPicker& picker, Xoshiro256& rng) {
+    switch (picker.type) {
+        case DIST_ZIPF: {
+            if (picker.count < 2) return 0;
+            double u = (rng.next() >> 11) * 0x1.0p-53;
+            double uz = u * picker.zetan;
+            if (uz < 1.0) return 0;
+            if (uz < picker.zipfSecondThreshold) return 1;
+            uint64_t rank = (uint64_t)(picker.count * pow(picker.eta * u - picker.eta + 1.0, picker.alpha));
+            return min(rank, picker.count - 1);
+        }
+        case DIST_HOTSPOT:
+            if (rng.next() < picker.hotThreshold) return rng.uniform(picker.hotCount);
+            return rng.uniform(picker.count);
+        default:
+            return rng.uniform(picker.count);
+    }
+}
+
+// One generated operation (op == OP_COUNT means "skip")
+struct GeneratedOp {
+    Money amount;
+    int32_t fromIndex;
+    int32_t toIndex;
+    uint8_t op;
+    uint32_t legSeed;       // multi-leg payments: seed the payees are drawn from
+};
+
+// ---------------------------------------------------------------------------
+// Trace replay: --replay PATH runs a recorded trace through the engine instead
+// of the random generator. A trace is either a binary journal (raw
+// JournalRecord structs, written by --journal-format binary) or a .csv file
+// with the columns client,op,from,to,amount,timestamp (written by
+// --journal-format csv; from/to are account numbers). The file is memory-
+// mapped and parsed once, in place, before the clients start: each record is
+// routed to the lane of logical client (client % --clients) + 1, in file
+// order, so every recorded client keeps its order. The lanes then run like
+// generated clients, on their own threads or on the --workers pool. With
+// --replay-speed X > 0, each record is due once its offset from the first
+// record's timestamp, divided by X, has elapsed; 0 replays as fast as possible.
+// ---------------------------------------------------------------------------
+
+enum TraceFormat {
+    TRACE_BINARY,
+    TRACE_CSV
+};
+
+// One trace record
+struct TraceEntry {
+    uint64_t timestamp;
+    uint64_t due;           // nanoseconds after the replay starts (--replay-speed > 0)
+    Money amount;
+    int32_t clientId;
+    int32_t fromIndex;
+    int32_t toIndex;        // transfers only
+    int op;                 // OP_COUNT if the record cannot be replayed
+};
+
+struct Trace {
+    int fd;
+    const char* data;
+    size_t size;
+    TraceFormat format;
+    const char* body;           // first record (CSV: after the header line)
+    uint64_t firstTimestamp;
+    uint64_t startNanos;        // replay clock origin
+    vector<vector<TraceEntry>> lanes;   // replayable records of each logical client
+    uint64_t skipped;           // unknown op, multi-leg payment, bad account or malformed line
+};
+
+Trace trace = { -1, nullptr, 0, TRACE_BINARY, nullptr, 0, 0, {}, 0 };
+
+// Function to parse a (possibly negative) integer field; cursor stops at the next non-digit.
+// Digits accumulate unsigned, so 64-bit account numbers round-trip through the cast.
+bool parseTraceInteger(const char*& cursor, const char* end, int64_t& value) {
+    bool negative = (cursor < end && *cursor == '-');
+    if (negative) cursor++;
+    const char* digits = cursor;
+    uint64_t magnitude = 0;
+    while (cursor < end && *cursor >= '0' && *cursor <= '9') magnitude = magnitude * 10 + (*cursor++ - '0');
+    value = negative ? (int64_t)(0 - magnitude) : (int64_t)magnitude;
+    return cursor > digits;
+}
+
+// Function to parse an amount such as 12.5, 12.34 or -0.50 into cents; the sign applies
+// to the whole amount, so -0.50 is -50 cents and -1.50 is -150
+bool parseTraceMoney(const char*& cursor, const char* end, Money& value) {
+    bool negative = (cursor < end && *cursor == '-');
+    if (negative) cursor++;
+    int64_t units;
+    if (cursor < end && *cursor == '-') return false;
+    if (!parseTraceInteger(cursor, end, units)) return false;
+    value = units * CENTS_PER_DOLLAR;
+    if (cursor < end && *cursor == '.') {
+        cursor++;
+        Money scale = CENTS_PER_DOLLAR / 10;
+        while (cursor < end && *cursor >= '0' && *cursor <= '9') {
+            value += (*cursor++ - '0') * scale;
+            scale /= 10;
+        }
+    }
+    if (negative) value = -value;
     return true;
 }
 
-// Function to withdraw money
-bool withdraw(int clientId, int accountIndex, double amount) {
-    bool success = false;
-    double currentBalance;
-    int accountNumber;
+// Function to expect a separator and step over it
+bool skipTraceSeparator(const char*& cursor, const char* end) {
+    if (cursor >= end || *cursor != ',') return false;
+    cursor++;
+    return true;
+}
+
+// Function to parse one CSV line (cursor is left at the start of the next line);
+// returns false if the line is malformed
+bool parseTraceLine(const char*& cursor, const char* end, TraceEntry& entry) {
+    const char* lineEnd = (const char*)memchr(cursor, '\n', end - cursor);
+    if (lineEnd == nullptr) lineEnd = end;
+    const char* field = cursor;
+    cursor = (lineEnd < end) ? lineEnd + 1 : end;
     
-    pthread_mutex_lock(&accounts[accountIndex].lock);
+    int64_t clientId, from, to = 0;
+    if (!parseTraceInteger(field, lineEnd, clientId) || !skipTraceSeparator(field, lineEnd)) return false;
+    entry.clientId = (int32_t)clientId;
     
-    accountNumber = accounts[accountIndex].accountNumber;
-    currentBalance = accounts[accountIndex].balance;
+    const char* name = field;
+    while (field < lineEnd && *field != ',') field++;
+    entry.op = OP_COUNT;
+    for (int op = 0; op < OP_COUNT; op++) {
+        if ((size_t)(field - name) == strlen(OP_NAMES[op]) && memcmp(name, OP_NAMES[op], field - name) == 0) entry.op = op;
+    }
     
-    if (currentBalance >= amount) {
-        accounts[accountIndex].balance -= amount;
-        double newBalance = accounts[accountIndex].balance;
-        pthread_mutex_unlock(&accounts[accountIndex].lock);
-        
-        logTransaction(clientId, accountNumber, 
-                       "WITHDRAW ", amount, newBalance);
-        success = true;
+    if (!skipTraceSeparator(field, lineEnd) || !parseTraceInteger(field, lineEnd, from) ||
+        !skipTraceSeparator(field, lineEnd)) return false;
+    parseTraceInteger(field, lineEnd, to);      // empty unless the record is a transfer
+    int64_t timestamp;
+    if (!skipTraceSeparator(field, lineEnd) || !parseTraceMoney(field, lineEnd, entry.amount) ||
+        !skipTraceSeparator(field, lineEnd) || !parseTraceInteger(field, lineEnd, timestamp)) return false;
+    entry.timestamp = (uint64_t)timestamp;
+    entry.fromIndex = accounts.findAccount((uint64_t)from);
+    entry.toIndex = (entry.op == OP_TRANSFER) ? accounts.findAccount((uint64_t)to) : -1;
+    return true;
+}
+
+// Function to read the next record of the trace; returns false at the end of the trace.
+// Records that cannot be replayed come back with op == OP_COUNT.
+bool nextTraceEntry(const char*& cursor, TraceEntry& entry) {
+    const char* end = trace.data + trace.size;
+    if (trace.format == TRACE_BINARY) {
+        if (cursor + sizeof(JournalRecord) > end) return false;
+        const JournalRecord* record = (const JournalRecord*)cursor;
+        cursor += sizeof(JournalRecord);
+        entry.timestamp = record->timestamp;
+        entry.amount = record->amount;
+        entry.clientId = record->clientId;
+        if (record->op >= OP_COUNT) {
+            // Unknown op code (corrupt or from a newer build): reject the record
+            entry.op = OP_COUNT;
+            return true;
+        }
+        entry.op = (int)record->op;
+        entry.fromIndex = (record->accountIndex >= 0 && record->accountIndex < (int32_t)accounts.size())
+                        ? record->accountIndex : -1;
+        entry.toIndex = (record->toAccountIndex >= 0 && record->toAccountIndex < (int32_t)accounts.size())
+                      ? record->toAccountIndex : -1;
+    } else {
+        if (cursor >= end) return false;
+        if (!parseTraceLine(cursor, end, entry)) {
+            entry.op = OP_COUNT;
+            return true;
+        }
+    }
+    // Multi-leg payments do not record their payees, so they cannot be replayed
+    bool replayable = entry.fromIndex >= 0 && 
+                      (entry.op == OP_BALANCE_INQUIRY ||
+                       ((entry.op == OP_DEPOSIT || entry.op == OP_WITHDRAW || entry.op == OP_TRANSFER) &&
+                        entry.amount > 0)) &&
+                      (entry.op != OP_TRANSFER || (entry.toIndex >= 0 && entry.toIndex != entry.fromIndex));
+    if (!replayable) entry.op = OP_COUNT;
+    return true;
+}
+
+// Function to wait until a point on the monotonic clock: sleep while it is far, then yield
+// (rather than spin) so other client threads can run on the same core
+void waitUntil(uint64_t deadline) {
+    uint64_t now;
+    while ((now = nowNanos()) < deadline) {
+        if (deadline - now > 200000) usleep((unsigned)((deadline - now - 100000) / 1000));
+        else sched_yield();
+    }
+}
+
+// Function to map a trace file read-only and find its first record
+bool mapTrace(const string& path) {
+    trace.format = (path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0) ? TRACE_CSV : TRACE_BINARY;
+    trace.fd = open(path.c_str(), O_RDONLY);
+    if (trace.fd < 0) {
+        cerr << "Cannot open trace " << path << ": " << strerror(errno) << endl;
+        return false;
+    }
+    struct stat st;
+    fstat(trace.fd, &st);
+    trace.size = (size_t)st.st_size;
+    if (trace.size > 0) {
+        void* mapped = mmap(nullptr, trace.size, PROT_READ, MAP_PRIVATE, trace.fd, 0);
+        if (mapped == MAP_FAILED) {
+            cerr << "Cannot map trace " << path << ": " << strerror(errno) << endl;
+            return false;
+        }
+        madvise(mapped, trace.size, MADV_SEQUENTIAL);
+        trace.data = (const char*)mapped;
+    }
+    
+    trace.body = trace.data;
+    const char* end = trace.data + trace.size;
+    if (trace.format == TRACE_CSV && trace.size > 0 && !(*trace.data >= '0' && *trace.data <= '9')) {
+        const char* lineEnd = (const char*)memchr(trace.data, '\n', trace.size);
+        trace.body = (lineEnd != nullptr) ? lineEnd + 1 : end;
+    }
+    if (trace.format == TRACE_BINARY && trace.size % sizeof(JournalRecord) != 0) {
+        cerr << "Trace " << path << " is not a binary journal (size is not a multiple of " 
+             << sizeof(JournalRecord) << " bytes)" << endl;
+        return false;
+    }
+    
+    // The first record that parses sets the origin of the replay clock
+    trace.firstTimestamp = 0;
+    const char* cursor = trace.body;
+    TraceEntry entry;
+    if (trace.format == TRACE_BINARY) {
+        if (cursor < end) trace.firstTimestamp = ((const JournalRecord*)cursor)->timestamp;
     } else {
-        pthread_mutex_unlock(&accounts[accountIndex].lock);
+        while (cursor < end) {
+            if (parseTraceLine(cursor, end, entry)) {
+                trace.firstTimestamp = entry.timestamp;
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+// Function to release the trace mapping
+void unmapTrace() {
+    if (trace.data != nullptr) munmap((void*)trace.data, trace.size);
+    if (trace.fd >= 0) close(trace.fd);
+    trace.data = nullptr;
+    trace.fd = -1;
+}
+
+// Function to parse a trace once and route its replayable records to config.numClients lanes
+bool loadTrace(const string& path) {
+    if (!mapTrace(path)) return false;
+    trace.lanes.assign(config.numClients, vector<TraceEntry>());
+    trace.skipped = 0;
+    const char* cursor = trace.body;
+    TraceEntry entry;
+    while (nextTraceEntry(cursor, entry)) {
+        if (entry.op == OP_COUNT) {
+            trace.skipped++;
+            continue;
+        }
+        uint64_t offset = entry.timestamp > trace.firstTimestamp ? entry.timestamp - trace.firstTimestamp : 0;
+        entry.due = config.replaySpeed > 0 ? (uint64_t)(offset / config.replaySpeed) : 0;
+        trace.lanes[(uint32_t)entry.clientId % config.numClients].push_back(entry);
+    }
+    unmapTrace();
+    return true;
+}
+
+// Logical client: the unit of work, independent of the thread that runs it
+struct ClientTask {
+    int clientId;
+    long long remaining;         // transactions still to perform
+    Xoshiro256 rng;
+    const GeneratedOp* ops;      // pre-generated stream, or nullptr to generate on the fly
+    const TraceEntry* replay;    // --replay: next record of this client's trace lane
+    uint64_t replayLagNanos;     // worst delay behind the recorded schedule
+    vector<TransferRequest> pendingTransfers;   // transfers waiting for a batch (--batch)
+};
+
+// Function to pick an operation according to the configured op mix
+OpType chooseOperation(Xoshiro256& rng) {
+    int totalWeight = 0;
+    for (int op = 0; op < OP_COUNT; op++) totalWeight += config.opWeights[op];
+    int pick = (int)rng.uniform(totalWeight);
+    for (int op = 0; op < OP_COUNT; op++) {
+        if (pick < config.opWeights[op]) return (OpType)op;
+        pick -= config.opWeights[op];
+    }
+    return OP_DEPOSIT;
+}
+
+// Function to generate the next operation of a client's stream
+void generateOperation(Xoshiro256& rng, GeneratedOp& generated) {
+    uint64_t accountCount = accounts.size();
+    OpType operation = chooseOperation(rng);
+    generated.fromIndex = (int32_t)pickAccount(accountPicker, rng);
+    generated.toIndex = -1;
+    // Amounts are uniform over [minAmount, maxAmount], inclusive
+    generated.amount = config.minAmount 
+                     + (Money)rng.uniform((uint64_t)(config.maxAmount - config.minAmount) + 1);
+    
+    if (operation == OP_TRANSFER) {
+        if (accountCount > 1) {
+            // Draw the target from the same distribution; if it keeps colliding with the
+            // source (tiny hot sets), fall back to a uniform pick among the other accounts
+            generated.toIndex = generated.fromIndex;
+            for (int attempt = 0; attempt < 8 && generated.toIndex == generated.fromIndex; attempt++) {
+                generated.toIndex = (int32_t)pickAccount(accountPicker, rng);
+            }
+            if (generated.toIndex == generated.fromIndex) {
+                generated.toIndex = (int32_t)rng.uniform(accountCount - 1);
+                if (generated.toIndex >= generated.fromIndex) generated.toIndex++;
+            }
+        } else {
+            operation = OP_COUNT;
+        }
+    }
+    if (operation == OP_MULTI) {
+        // Payees are drawn when the payment runs, so every GeneratedOp stays the same size
+        generated.legSeed = (uint32_t)rng.next();
+        if (accountCount < 2) operation = OP_COUNT;
+    }
+    generated.op = (uint8_t)operation;
+}
+
+// Function to draw the payees of a multi-leg payment from its seed (same distribution as other picks)
+void generatePayees(uint32_t legSeed, vector<int32_t>& payees) {
+    Xoshiro256 rng;
+    rng.seed(config.seed, ((uint64_t)1 << 32) | legSeed);
+    payees.resize(config.multiLegs);
+    for (int j = 0; j < config.multiLegs; j++) payees[j] = (int32_t)pickAccount(accountPicker, rng);
+}
+
+// Function to execute a generated operation on the configured engine
+bool executeOperation(int clientId, const GeneratedOp& generated) {
+    switch (generated.op) {
+        case OP_DEPOSIT:
+            return engine->deposit(clientId, generated.fromIndex, generated.amount);
+        case OP_WITHDRAW:
+            return engine->withdraw(clientId, generated.fromIndex, generated.amount);
+        case OP_TRANSFER:
+            return engine->transfer(clientId, generated.fromIndex, generated.toIndex, generated.amount);
+        case OP_MULTI: {
+            thread_local vector<int32_t> payees;
+            generatePayees(generated.legSeed, payees);
+            return engine->multiTransfer(clientId, generated.fromIndex, payees.data(), (int)payees.size(),
+                                         generated.amount);
+        }
+        case OP_BALANCE_INQUIRY:
+            return balanceInquiry(clientId, generated.fromIndex);
+        default:
+            return false;
+    }
+}
+
+// Function to set up a client's generator (and its pre-generated stream, if any)
+void initClientTask(ClientTask& task, int clientId, const GeneratedOp* ops) {
+    task.clientId = clientId;
+    task.remaining = config.transactionsPerClient;
+    task.rng.seed(config.seed, (uint64_t)clientId);
+    task.ops = ops;
+    task.replay = nullptr;
+    task.replayLagNanos = 0;
+    if (!trace.lanes.empty()) {
+        // Replay: the client runs its lane of the trace instead of generating operations
+        const vector<TraceEntry>& lane = trace.lanes[clientId - 1];
+        task.replay = lane.data();
+        task.remaining = (long long)lane.size();
+    }
+    task.pendingTransfers.clear();
+    if (config.batchSize > 0) task.pendingTransfers.reserve(config.batchSize);
+}
+
+// Function to pre-generate every client's operation stream into one contiguous buffer
+GeneratedOp* pregenerateWorkload() {
+    long long perClient = config.transactionsPerClient;
+    GeneratedOp* ops = new GeneratedOp[(size_t)config.numClients * perClient];
+    for (int c = 0; c < config.numClients; c++) {
+        Xoshiro256 rng;
+        rng.seed(config.seed, (uint64_t)(c + 1));
+        GeneratedOp* stream = ops + (size_t)c * perClient;
+        for (long long i = 0; i < perClient; i++) generateOperation(rng, stream[i]);
+    }
+    return ops;
+}
+
+// Function to fetch a client's next operation from its stream or its generator
+const GeneratedOp& nextOperation(ClientTask& task, GeneratedOp& scratch) {
+    if (task.ops != nullptr) {
+        return task.ops[config.transactionsPerClient - task.remaining];
+    }
+    generateOperation(task.rng, scratch);
+    return scratch;
+}
+
+// Client thread function
+void* clientThread(void* arg) {
+    ClientTask* task = (ClientTask*)arg;
+    
+    while (task->remaining > 0) {
+        GeneratedOp generated;
+        executeOperation(task->clientId, nextOperation(*task, generated));
+        task->remaining--;
         
-        pthread_mutex_lock(&logMutex);
-        time_t now = time(nullptr);
-        tm* localTime = localtime(&now);
-        cout << Colors::DIM << "[" << put_time(localTime, "%H:%M:%S") << "]" << Colors::RESET << " "
-             << Colors::BRIGHT_CYAN << "Client " << clientId << Colors::RESET << " | "
-             << Colors::RED << "⚠️  INSUFFICIENT FUNDS" << Colors::RESET
-             << " | Attempted: $" << Colors::BOLD << fixed << setprecision(2) << amount << Colors::RESET
-             << " | " << Colors::MAGENTA << "Account " << accountNumber << Colors::RESET
-             << " | " << Colors::YELLOW << "Current Balance: $" << fixed << setprecision(2) 
-             << currentBalance << Colors::RESET << endl;
-        pthread_mutex_unlock(&logMutex);
-    }
-    
-    return success;
-}
-
-// Function to transfer money between accounts
-bool transfer(int clientId, int fromAccountIndex, int toAccountIndex, double amount) {
-    // Lock both accounts in order to prevent deadlock
-    int first = min(fromAccountIndex, toAccountIndex);
-    int second = max(fromAccountIndex, toAccountIndex);
-    
-    pthread_mutex_lock(&accounts[first].lock);
-    pthread_mutex_lock(&accounts[second].lock);
-    
-    bool success = false;
-    if (accounts[fromAccountIndex].balance >= amount) {
-        accounts[fromAccountIndex].balance -= amount;
-        accounts[toAccountIndex].balance += amount;
+        // Random delay to simulate real-world transaction time
+        usleep(task->rng.uniform(200000) + 50000); // 50ms to 250ms
+    }
+    
+    return nullptr;
+}
+
+// Benchmark deadline shared by all clients (0 = no time limit)
+uint64_t benchmarkDeadline = 0;
+
+// Function to execute a client's pending transfers as one batch; each item is
+// charged the latency of the whole batch, since that is what its caller waits for
+void flushTransferBatch(ClientTask& task, ClientStats& stats) {
+    int count = (int)task.pendingTransfers.size();
+    if (count == 0) return;
+    
+    thread_local vector<TransferResult> results;
+    results.resize(count);
+    uint64_t start = nowNanos();
+    engine->transferBatch(task.clientId, task.pendingTransfers.data(), count, results.data());
+    if (wal.sync) walWaitForCommit();
+    uint64_t elapsed = nowNanos() - start;
+    
+    for (int i = 0; i < count; i++) stats.record(OP_TRANSFER, results[i].success, elapsed, results[i].refused);
+    stats.transferBatches++;
+    stats.batchedTransfers += count;
+    task.pendingTransfers.clear();
+}
+
+// Function to replay up to maxOps records of a client's trace lane; returns true when it is finished.
+// A record that is not due yet is waited for, on the client's thread or on the worker running it.
+bool runReplaySlice(ClientTask& task, ClientStats& stats, long long maxOps) {
+    for (long long i = 0; i < maxOps && task.remaining > 0; i++) {
+        const TraceEntry& entry = *task.replay++;
+        task.remaining--;
+        if (config.replaySpeed > 0) {
+            uint64_t due = trace.startNanos + entry.due;
+            if (benchmarkDeadline != 0 && due >= benchmarkDeadline) {
+                task.remaining = 0;
+                break;
+            }
+            waitUntil(due);
+            task.replayLagNanos = max(task.replayLagNanos, nowNanos() - due);
+        }
         
-        double fromBalance = accounts[fromAccountIndex].balance;
-        double toBalance = accounts[toAccountIndex].balance;
+        GeneratedOp generated;
+        generated.op = (uint8_t)entry.op;
+        generated.fromIndex = entry.fromIndex;
+        generated.toIndex = entry.toIndex;
+        generated.amount = entry.amount;
+        uint64_t refusals = threadWalRefusals;
+        uint64_t start = nowNanos();
+        bool success = executeOperation(entry.clientId, generated);
+        if (wal.sync) walWaitForCommit();
+        uint64_t end = nowNanos();
         
-        pthread_mutex_unlock(&accounts[second].lock);
-        pthread_mutex_unlock(&accounts[first].lock);
+        stats.record(entry.op, success, end - start, threadWalRefusals != refusals);
+        if (success && entry.op == OP_DEPOSIT) stats.deposited += entry.amount;
+        if (success && entry.op == OP_WITHDRAW) stats.withdrawn += entry.amount;
+        if (benchmarkDeadline != 0 && end >= benchmarkDeadline) task.remaining = 0;
+    }
+    return task.remaining == 0;
+}
+
+// Function to run up to maxOps timed transactions for a client; returns true when it is finished.
+// With --batch, transfers are queued and executed in batches while deposits and
+// withdrawals run immediately. The queue belongs to the task and survives across slices;
+// a partial batch is only flushed once the client has finished (or the deadline passed).
+bool runClientSlice(ClientTask& task, ClientStats& stats, long long maxOps) {
+    if (!trace.lanes.empty()) return runReplaySlice(task, stats, maxOps);
+    for (long long i = 0; i < maxOps && task.remaining > 0; i++) {
+        GeneratedOp scratch;
+        const GeneratedOp& generated = nextOperation(task, scratch);
         
-        // Log transfer
-        pthread_mutex_lock(&logMutex);
-        time_t now = time(nullptr);
-        tm* localTime = localtime(&now);
-        totalTransactionsCompleted++;
-        int totalTransactions = config.numClients * config.transactionsPerClient;
-        int progress = (totalTransactionsCompleted * 100) / totalTransactions;
+        if (config.batchSize > 0 && generated.op == OP_TRANSFER) {
+            TransferRequest request = { generated.fromIndex, generated.toIndex, generated.amount };
+            task.pendingTransfers.push_back(request);
+            task.remaining--;
+            if ((int)task.pendingTransfers.size() == config.batchSize) flushTransferBatch(task, stats);
+            if (benchmarkDeadline != 0 && nowNanos() >= benchmarkDeadline) task.remaining = 0;
+            continue;
+        }
         
-        cout << Colors::DIM << "[" << put_time(localTime, "%H:%M:%S") << "]" << Colors::RESET << " "
-             << Colors::BRIGHT_CYAN << "Client " << clientId << Colors::RESET << " | "
-             << Colors::BLUE << "🔄 TRANSFER" << Colors::RESET
-             << " $" << Colors::BOLD << fixed << setprecision(2) << amount << Colors::RESET
-             << " | " << Colors::MAGENTA << "Account " << accounts[fromAccountIndex].accountNumber 
-             << Colors::RESET << " → " << Colors::MAGENTA << "Account " 
-             << accounts[toAccountIndex].accountNumber << Colors::RESET
-             << " | From: $" << fixed << setprecision(2) << fromBalance
-             << " | To: $" << fixed << setprecision(2) << toBalance
-             << " [" << Colors::BRIGHT_YELLOW << progress << "%" << Colors::RESET << "]" << endl;
-        pthread_mutex_unlock(&logMutex);
+        uint64_t refusals = threadWalRefusals;
+        uint64_t start = nowNanos();
+        bool success = executeOperation(task.clientId, generated);
+        if (wal.sync) walWaitForCommit();
+        uint64_t end = nowNanos();
+        task.remaining--;
         
-        success = true;
-    } else {
-        pthread_mutex_unlock(&accounts[second].lock);
-        pthread_mutex_unlock(&accounts[first].lock);
+        if (generated.op != OP_COUNT) {
+            stats.record(generated.op, success, end - start, threadWalRefusals != refusals);
+            if (success && generated.op == OP_DEPOSIT) stats.deposited += generated.amount;
+            if (success && generated.op == OP_WITHDRAW) stats.withdrawn += generated.amount;
+        }
         
-        pthread_mutex_lock(&logMutex);
-        time_t now = time(nullptr);
-        tm* localTime = localtime(&now);
-        cout << Colors::DIM << "[" << put_time(localTime, "%H:%M:%S") << "]" << Colors::RESET << " "
-             << Colors::BRIGHT_CYAN << "Client " << clientId << Colors::RESET << " | "
-             << Colors::RED << "❌ TRANSFER FAILED" << Colors::RESET
-             << " | Insufficient funds in " << Colors::MAGENTA << "Account " 
-             << accounts[fromAccountIndex].accountNumber << Colors::RESET << endl;
-        pthread_mutex_unlock(&logMutex);
+        if (benchmarkDeadline != 0 && end >= benchmarkDeadline) task.remaining = 0;
     }
-    
-    return success;
+    if (task.remaining == 0) flushTransferBatch(task, stats);
+    return task.remaining == 0;
 }
 
-// Client thread function
-void* clientThread(void* arg) {
-    int clientId = *((int*)arg);
+// Benchmark client with a dedicated thread: no pacing, every operation is timed
+struct BenchmarkClient {
+    ClientTask task;
+    ClientStats stats;
+};
+
+// Benchmark client thread function
+void* benchmarkClientThread(void* arg) {
+    BenchmarkClient* client = (BenchmarkClient*)arg;
+    runClientSlice(client->task, client->stats, LLONG_MAX);
+    return nullptr;
+}
+
+// ---------------------------------------------------------------------------
+// Work-stealing scheduler
+//
+// A fixed pool of worker threads runs the logical clients. Each worker owns a
+// Chase-Lev deque of ClientTasks: it runs a slice of CLIENT_SLICE_OPS
+// transactions from the task at the bottom, pushes the task back if it is not
+// finished, and steals from the top of a random victim's deque when its own
+// deque is empty. Thread count is bounded by --workers, not by --clients.
+// ---------------------------------------------------------------------------
+
+const long long CLIENT_SLICE_OPS = 64;
+
+// Chase-Lev work-stealing deque: the owner pushes/pops at the bottom, thieves take from the top
+struct WorkStealingDeque {
+    alignas(64) atomic<int64_t> top;
+    alignas(64) atomic<int64_t> bottom;
+    int64_t mask;
+    atomic<ClientTask*>* buffer;
     
-    for (int i = 0; i < config.transactionsPerClient; i++) {
-        int operation = rand() % 3; // 0: deposit, 1: withdraw, 2: transfer
-        int accountIndex = rand() % accounts.size();
-        double amount = config.minAmount + 
-                       (rand() % (int)((config.maxAmount - config.minAmount) * 100)) / 100.0;
+    // capacity must be a power of two no smaller than the number of tasks
+    explicit WorkStealingDeque(int64_t capacity) 
+        : top(0), bottom(0), mask(capacity - 1), buffer(new atomic<ClientTask*>[capacity]) {}
+    ~WorkStealingDeque() { delete[] buffer; }
+    
+    void push(ClientTask* task) {
+        int64_t b = bottom.load(memory_order_relaxed);
+        buffer[b & mask].store(task, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        bottom.store(b + 1, memory_order_relaxed);
+    }
+    
+    ClientTask* pop() {
+        int64_t b = bottom.load(memory_order_relaxed) - 1;
+        bottom.store(b, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        int64_t t = top.load(memory_order_relaxed);
         
-        switch (operation) {
-            case 0: // Deposit
-                deposit(clientId, accountIndex, amount);
-                break;
-                
-            case 1: // Withdraw
-                withdraw(clientId, accountIndex, amount);
-                break;
-                
-            case 2: // Transfer
-                if (accounts.size() > 1) {
-                    int toAccountIndex = rand() % accounts.size();
-                    while (toAccountIndex == accountIndex) {
-                        toAccountIndex = rand() % accounts.size();
-                    }
-                    transfer(clientId, accountIndex, toAccountIndex, amount);
-                }
-                break;
+        if (t > b) {
+            bottom.store(b + 1, memory_order_relaxed);
+            return nullptr;
         }
+        ClientTask* task = buffer[b & mask].load(memory_order_relaxed);
+        if (t == b) {
+            // Last task: race against thieves for it
+            if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed)) {
+                task = nullptr;
+            }
+            bottom.store(b + 1, memory_order_relaxed);
+        }
+        return task;
+    }
+    
+    ClientTask* steal() {
+        int64_t t = top.load(memory_order_acquire);
+        atomic_thread_fence(memory_order_seq_cst);
+        int64_t b = bottom.load(memory_order_acquire);
+        if (t >= b) return nullptr;
         
-        // Random delay to simulate real-world transaction time
-        usleep((rand() % 200000) + 50000); // 50ms to 250ms
+        ClientTask* task = buffer[t & mask].load(memory_order_relaxed);
+        if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed)) {
+            return nullptr;
+        }
+        return task;
+    }
+};
+
+struct Worker {
+    int id;
+    WorkStealingDeque* deque;
+    ClientStats stats;
+    unsigned int stealSeed;
+    uint64_t steals;
+    pthread_t thread;
+};
+
+struct WorkerPool {
+    vector<Worker*> workers;
+    atomic<long long> unfinishedClients;
+};
+
+WorkerPool pool;
+
+// Function to steal a task from a random victim, trying each worker once
+ClientTask* stealTask(Worker* self) {
+    int count = (int)pool.workers.size();
+    int first = rand_r(&self->stealSeed) % count;
+    for (int i = 0; i < count; i++) {
+        Worker* victim = pool.workers[(first + i) % count];
+        if (victim == self) continue;
+        ClientTask* task = victim->deque->steal();
+        if (task != nullptr) {
+            self->steals++;
+            return task;
+        }
     }
+    return nullptr;
+}
+
+// Worker thread function
+void* workerThread(void* arg) {
+    Worker* self = (Worker*)arg;
     
+    while (pool.unfinishedClients.load(memory_order_acquire) > 0) {
+        ClientTask* task = self->deque->pop();
+        if (task == nullptr) task = stealTask(self);
+        if (task == nullptr) {
+            sched_yield();
+            continue;
+        }
+        
+        if (runClientSlice(*task, self->stats, CLIENT_SLICE_OPS)) {
+            pool.unfinishedClients.fetch_sub(1, memory_order_acq_rel);
+        } else {
+            self->deque->push(task);
+        }
+    }
     return nullptr;
 }
 
+// Function to run every client on its own thread (the classic model)
+bool runThreadPerClient(vector<ClientStats*>& threadStats, vector<BenchmarkClient*>& clients,
+                        const GeneratedOp* workload) {
+    vector<pthread_t> threads(config.numClients);
+    
+    for (int i = 0; i < config.numClients; i++) {
+        clients.push_back(new BenchmarkClient());
+        initClientTask(clients[i]->task, i + 1, 
+                       workload ? workload + (size_t)i * config.transactionsPerClient : nullptr);
+        threadStats.push_back(&clients[i]->stats);
+        registerMetricsSource(&clients[i]->stats);
+        if (pthread_create(&threads[i], nullptr, benchmarkClientThread, clients[i]) != 0) {
+            cerr << "Error creating thread " << i << endl;
+            return false;
+        }
+    }
+    
+    for (int i = 0; i < config.numClients; i++) {
+        if (pthread_join(threads[i], nullptr) != 0) {
+            cerr << "Error joining thread " << i << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Function to run all clients on a fixed pool of work-stealing workers
+bool runWorkerPool(vector<ClientStats*>& threadStats, vector<ClientTask>& tasks, 
+                   const GeneratedOp* workload, uint64_t& steals) {
+    int64_t capacity = 1;
+    while (capacity < config.numClients) capacity <<= 1;
+    
+    tasks.resize(config.numClients);
+    pool.unfinishedClients.store(config.numClients);
+    for (int w = 0; w < config.workers; w++) {
+        Worker* worker = new Worker();
+        worker->id = w;
+        worker->deque = new WorkStealingDeque(capacity);
+        worker->stealSeed = config.seed + w;
+        worker->steals = 0;
+        pool.workers.push_back(worker);
+        threadStats.push_back(&worker->stats);
+        registerMetricsSource(&worker->stats);
+    }
+    // Deal the clients out round-robin before any worker starts
+    for (int i = 0; i < config.numClients; i++) {
+        initClientTask(tasks[i], i + 1, 
+                       workload ? workload + (size_t)i * config.transactionsPerClient : nullptr);
+        pool.workers[i % config.workers]->deque->push(&tasks[i]);
+    }
+    
+    for (Worker* worker : pool.workers) {
+        if (pthread_create(&worker->thread, nullptr, workerThread, worker) != 0) {
+            cerr << "Error creating worker thread " << worker->id << endl;
+            return false;
+        }
+    }
+    
+    steals = 0;
+    for (Worker* worker : pool.workers) {
+        if (pthread_join(worker->thread, nullptr) != 0) {
+            cerr << "Error joining worker thread " << worker->id << endl;
+            return false;
+        }
+        steals += worker->steals;
+    }
+    return true;
+}
+
+// Function to release the worker pool (its stats must no longer be referenced)
+void destroyWorkerPool() {
+    for (Worker* worker : pool.workers) {
+        delete worker->deque;
+        delete worker;
+    }
+    pool.workers.clear();
+}
+
 // Function to print final account balances and statistics
 void printFinalReport() {
     cout << "\n\n";
     printSeparator("FINAL ACCOUNT REPORT");
     cout << endl;
     
-    for (size_t i = 0; i < accounts.size(); i++) {
-        auto& acc = accounts[i];
+    long long totalTrans = 0;
+    for (int i = 0; i < (int)accounts.size(); i++) {
+        // Walk the account's chain (newest first), keeping the last five records
+        const Transaction* recent[5];
+        int recentCount = 0;
+        long long historySize = 0;
+        for (TxnRef ref = accounts.historyHead(i).load(memory_order_acquire); ref != NO_TXN; ) {
+            const Transaction& trans = getTransaction(ref);
+            if (recentCount < 5) recent[recentCount++] = &trans;
+            historySize++;
+            ref = trans.previous;
+        }
+        totalTrans += historySize;
         
         cout << Colors::BRIGHT_BLUE << "┌" << string(78, '─') << "┐" << Colors::RESET << endl;
         cout << Colors::BRIGHT_BLUE << "│" << Colors::RESET 
-             << Colors::BOLD << Colors::CYAN << "  Account #" << acc.accountNumber 
+             << Colors::BOLD << Colors::CYAN << "  Account #" << accounts.accountNumber(i) 
              << Colors::RESET << string(60, ' ') << Colors::BRIGHT_BLUE << "│" << Colors::RESET << endl;
         cout << Colors::BRIGHT_BLUE << "├" << string(78, '─') << "┤" << Colors::RESET << endl;
         
         cout << Colors::BRIGHT_BLUE << "│" << Colors::RESET 
              << "  " << Colors::YELLOW << "Final Balance:" << Colors::RESET 
-             << string(20, ' ') << Colors::BRIGHT_GREEN << "$" << fixed << setprecision(2) 
-             << setw(12) << acc.balance << Colors::RESET 
+             << string(20, ' ') << Colors::BRIGHT_GREEN << "$" 
+             << setw(12) << formatMoney(engine->balance(i)) << Colors::RESET 
              << string(40, ' ') << Colors::BRIGHT_BLUE << "│" << Colors::RESET << endl;
         
         cout << Colors::BRIGHT_BLUE << "│" << Colors::RESET 
              << "  " << Colors::YELLOW << "Total Transactions:" << Colors::RESET 
-             << string(15, ' ') << Colors::BRIGHT_CYAN << acc.transactionHistory.size() 
+             << string(15, ' ') << Colors::BRIGHT_CYAN << historySize 
              << Colors::RESET << string(40, ' ') << Colors::BRIGHT_BLUE << "│" << Colors::RESET << endl;
         
-        if (!acc.transactionHistory.empty()) {
+        if (recentCount > 0) {
             cout << Colors::BRIGHT_BLUE << "├" << string(78, '─') << "┤" << Colors::RESET << endl;
             cout << Colors::BRIGHT_BLUE << "│" << Colors::RESET 
                  << "  " << Colors::BOLD << Colors::MAGENTA << "Last 5 Transactions:" 
                  << Colors::RESET << string(50, ' ') << Colors::BRIGHT_BLUE << "│" << Colors::RESET << endl;
             
-            int start = max(0, (int)acc.transactionHistory.size() - 5);
-            for (int j = start; j < acc.transactionHistory.size(); j++) {
-                const Transaction& trans = acc.transactionHistory[j];
-                tm* localTime = localtime(&trans.timestamp);
+            for (int j = recentCount - 1; j >= 0; j--) {
+                const Transaction& trans = *recent[j];
+                time_t seconds = (time_t)(trans.timestamp / 1000000000ULL);
+                tm* localTime = localtime(&seconds);
                 
-                string typeColor = (trans.type.find("DEPOSIT") != string::npos) ? Colors::GREEN :
-                                  (trans.type.find("WITHDRAW") != string::npos) ? Colors::YELLOW : Colors::BLUE;
+                string typeColor = (trans.op == OP_DEPOSIT) ? Colors::GREEN :
+                                  (trans.op == OP_WITHDRAW) ? Colors::YELLOW : Colors::BLUE;
+                const char* typeName = (trans.op == OP_DEPOSIT) ? "DEPOSIT  " :
+                                       (trans.op == OP_WITHDRAW) ? "WITHDRAW " : "TRANSFER ";
                 
                 cout << Colors::BRIGHT_BLUE << "│" << Colors::RESET 
                      << "    " << Colors::DIM << "[" << put_time(localTime, "%H:%M:%S") << "]" << Colors::RESET
                      << " Client " << Colors::BRIGHT_CYAN << trans.clientId << Colors::RESET
-                     << " | " << typeColor << trans.type << Colors::RESET
-                     << " $" << fixed << setprecision(2) << setw(8) << trans.amount
-                     << " | Balance: $" << fixed << setprecision(2) << setw(10) << trans.balanceAfter
+                     << " | " << typeColor << typeName << Colors::RESET
+                     << " $" << setw(8) << formatMoney(trans.amount)
+                     << " | Balance: $" << setw(10) << formatMoney(trans.balanceAfter)
                      << string(20, ' ') << Colors::BRIGHT_BLUE << "│" << Colors::RESET << endl;
             }
         }
         
         cout << Colors::BRIGHT_BLUE << "└" << string(78, '─') << "┘" << Colors::RESET << endl;
-        if (i < accounts.size() - 1) cout << endl;
+        if (i < (int)accounts.size() - 1) cout << endl;
     }
     
     // Summary statistics
-    double totalBalance = 0;
-    int totalTrans = 0;
-    for (auto& acc : accounts) {
-        totalBalance += acc.balance;
-        totalTrans += acc.transactionHistory.size();
-    }
+    Reconciliation reconciliation = reconcileBalances(accounts);
+    Money totalBalance = reconciliation.total;
+    Money expectedBalance = config.numAccounts * config.initialBalance 
+                          + journal.deposited - journal.withdrawn;
     
     cout << "\n";
     printSeparator("SUMMARY STATISTICS");
     cout << Colors::BRIGHT_GREEN << "  ✓ Total Accounts: " << Colors::RESET << accounts.size() << endl;
     cout << Colors::BRIGHT_GREEN << "  ✓ Total Balance: " << Colors::RESET 
-         << "$" << fixed << setprecision(2) << totalBalance << endl;
+         << "$" << formatMoney(totalBalance) << endl;
     cout << Colors::BRIGHT_GREEN << "  ✓ Total Transactions: " << Colors::RESET << totalTrans << endl;
     cout << Colors::BRIGHT_GREEN << "  ✓ Average Balance: " << Colors::RESET 
-         << "$" << fixed << setprecision(2) << (totalBalance / accounts.size()) << endl;
+         << "$" << formatMoney(totalBalance / (Money)accounts.size()) << endl;
+    if (totalBalance == expectedBalance) {
+        cout << Colors::BRIGHT_GREEN << "  ✓ Money Conserved: " << Colors::RESET 
+             << "initial + deposits - withdrawals = $" << formatMoney(expectedBalance) << endl;
+    } else {
+        cout << Colors::RED << "  ❌ Money NOT Conserved: " << Colors::RESET 
+             << "expected $" << formatMoney(expectedBalance) << endl;
+    }
+}
+
+// Function to print per-account contention: totals and the most contended accounts
+void printContentionReport(int topCount) {
+    uint64_t totalBlocked = 0;
+    uint64_t totalWait = 0;
+    vector<pair<uint64_t, int>> ranked;
+    for (int i = 0; i < (int)accounts.size(); i++) {
+        uint64_t blocked = accounts.contention[i].blocked.load(memory_order_relaxed);
+        totalBlocked += blocked;
+        totalWait += accounts.contention[i].waitNanos.load(memory_order_relaxed);
+        if (blocked > 0) ranked.push_back(make_pair(blocked, i));
+    }
+    
+    // The mutex engine counts lock acquisitions that had to wait, the optimistic engine
+    // aborted attempts, the atomic engine CAS retries
+    bool lockBased = (engine == &ENGINES[ENGINE_MUTEX]);
+    const char* metric = lockBased ? "lock_blocked" 
+                       : (engine == &ENGINES[ENGINE_OPTIMISTIC]) ? "occ_aborts" : "cas_retries";
+    cout << metric << "=" << totalBlocked;
+    if (lockBased) cout << " lock_wait_ms=" << totalWait / 1000000;
+    cout << " contended_accounts=" << ranked.size() << endl;
+    
+    int shown = min(topCount, (int)ranked.size());
+    partial_sort(ranked.begin(), ranked.begin() + shown, ranked.end(), 
+                 [](const pair<uint64_t, int>& a, const pair<uint64_t, int>& b) { return a.first > b.first; });
+    for (int k = 0; k < shown; k++) {
+        int i = ranked[k].second;
+        cout << "  account=" << accounts.accountNumber(i) << " " << metric << "=" << ranked[k].first;
+        if (lockBased) {
+            cout << " lock_wait_us=" << accounts.contention[i].waitNanos.load(memory_order_relaxed) / 1000;
+        }
+        cout << endl;
+    }
+}
+
+// Function to print the headless benchmark report (plain text, no ANSI colors)
+void printBenchmarkReport(const ClientStats& total, uint64_t elapsedNanos, Money openingTotal) {
+    double seconds = elapsedNanos / 1e9;
+    uint64_t totalOps = 0;
+    for (int op = 0; op < OP_COUNT; op++) {
+        totalOps += total.succeeded(op) + total.failed(op);
+    }
+    
+    uint64_t reconcileStart = nowNanos();
+    Reconciliation reconciliation = reconcileBalances(accounts);
+    uint64_t reconcileNanos = nowNanos() - reconcileStart;
+    Money expectedBalance = openingTotal + total.deposited - total.withdrawn;
+    
+    cout << "=== Benchmark Report ===" << endl;
+    cout << "accounts=" << config.numAccounts << " clients=" << config.numClients
+         << " layout=" << (config.accountLayout == LAYOUT_PACKED ? "packed" : "padded")
+         << " engine=" << engine->name;
+    if (config.engine == ENGINE_MUTEX) cout << " lock=" << LOCK_POLICY_NAMES[config.lockPolicy];
+    cout << " seed=" << config.seed;
+    if (config.distribution == DIST_ZIPF) cout << " distribution=zipf:" << config.zipfTheta;
+    else if (config.distribution == DIST_HOTSPOT) {
+        cout << " distribution=hotspot:" << config.hotspotAccountsPercent << ":" << config.hotspotOpsPercent;
+    } else cout << " distribution=uniform";
+    cout << endl;
+    cout << "elapsed_s=" << fixed << setprecision(3) << seconds
+         << " total_ops=" << totalOps
+         << " ops_per_sec=" << fixed << setprecision(0) << (seconds > 0 ? totalOps / seconds : 0) << endl;
+    cout << endl;
+    cout << left << setw(10) << "op" << right
+         << setw(12) << "ok" << setw(12) << "failed"
+         << setw(12) << "p50_ns" << setw(12) << "p99_ns" << setw(12) << "p999_ns"
+         << setw(14) << "max_ns" << endl;
+    for (int op = 0; op < OP_COUNT; op++) {
+        if (config.opWeights[op] == 0 && total.succeeded(op) + total.failed(op) == 0) continue;
+        LatencyHistogram h;
+        for (int outcome = 0; outcome < OUTCOME_COUNT; outcome++) h.merge(total.latency[op][outcome]);
+        cout << left << setw(10) << OP_NAMES[op] << right
+             << setw(12) << total.succeeded(op) << setw(12) << total.failed(op)
+             << setw(12) << h.percentile(50.0) << setw(12) << h.percentile(99.0)
+             << setw(12) << h.percentile(99.9) << setw(14) << h.maximum() << endl;
+    }
+    cout << endl;
+    cout << "total_balance=" << formatMoney(reconciliation.total)
+         << " expected_balance=" << formatMoney(expectedBalance)
+         << " conserved=" << (reconciliation.total == expectedBalance ? "yes" : "NO")
+         << " negative_balances=" << reconciliation.negativeCount
+         << " min_balance=" << formatMoney(reconciliation.minBalance) << endl;
+    cout << "reconcile_kernel=" << reconciliation.kernel
+         << " reconcile_ns=" << reconcileNanos << endl;
+    printContentionReport(5);
+    
+    if (history.enabled) {
+        uint64_t records, bytes;
+        getHistoryUsage(records, bytes);
+        cout << "history_records=" << records << " history_bytes=" << bytes
+             << " record_size=" << sizeof(Transaction)
+             << " bytes_per_million_txns=" << (records > 0 ? bytes * 1000000 / records : 0) << endl;
+    }
+}
+
+// Function to run the simulation headless: no prompts, no pacing, no live log
+int runBenchmark() {
+    // An existing log decides the account set it was written for
+    if (!config.walPath.empty()) {
+        uint64_t capacity = config.walCapacity > 0 
+                          ? config.walCapacity : (uint64_t)config.numClients * config.transactionsPerClient;
+        if (!mapWal(config.walPath, true, capacity)) return 1;
+        config.numAccounts = (int)wal.header->numAccounts;
+        config.initialBalance = wal.header->initialBalance;
+    }
+    // ...and so does a snapshot
+    if (!config.loadSnapshotPath.empty()) {
+        SnapshotHeader header;
+        if (!readSnapshotHeader(config.loadSnapshotPath, header)) return 1;
+        config.numAccounts = (int)header.numAccounts;
+    }
+    if (!initAccountStore(accounts, config.numAccounts, config.initialBalance, 
+                          (AccountLayout)config.accountLayout, (AccountNumbering)config.accountNumbering,
+                          (LockPolicy)config.lockPolicy)) {
+        cerr << "Error allocating " << config.numAccounts << " accounts" << endl;
+        return 1;
+    }
+    initAccountPicker(accountPicker, accounts.size());
+    uint64_t loadNanos = 0;
+    if (!config.loadSnapshotPath.empty()) {
+        uint64_t loadStart = nowNanos();
+        if (!loadSnapshot(config.loadSnapshotPath)) return 1;
+        loadNanos = nowNanos() - loadStart;
+    }
+    if (!config.walPath.empty() && !startWal(config.walSync, config.walIntervalMicros, config.walBatch)) {
+        return 1;
+    }
+    Money openingTotal = reconcileBalances(accounts).total;
+    
+    FILE* journalOut = nullptr;
+    if (!config.journalPath.empty()) {
+        journalOut = (config.journalPath == "-") ? stdout : fopen(config.journalPath.c_str(), "wb");
+        if (journalOut == nullptr) {
+            cerr << "Cannot open journal file " << config.journalPath << ": " << strerror(errno) << endl;
+            return 1;
+        }
+        if (!startJournal(journalOut, (JournalFormat)config.journalFormat, 
+                          (JournalPolicy)config.journalPolicy, config.journalCapacity)) {
+            cerr << "Error creating journal writer thread" << endl;
+            return 1;
+        }
+    }
+    
+    vector<ClientStats*> threadStats;
+    vector<BenchmarkClient*> clients;
+    vector<ClientTask> tasks;
+    uint64_t steals = 0;
+    
+    GeneratedOp* workload = nullptr;
+    uint64_t pregenNanos = 0;
+    if (config.pregenerate) {
+        uint64_t pregenStart = nowNanos();
+        workload = pregenerateWorkload();
+        pregenNanos = nowNanos() - pregenStart;
+    }
+    
+    if (!config.replayPath.empty() && !loadTrace(config.replayPath)) return 1;
+    if (engine->start != nullptr && !engine->start()) return 1;
+    if (!config.snapshotPath.empty() && !startSnapshots(config.snapshotPath, config.snapshotIntervalSeconds)) {
+        return 1;
+    }
+    if (config.audit && !startAuditor(config.auditIntervalSeconds, config.auditTrailCapacity, openingTotal)) {
+        return 1;
+    }
+    if (!config.metricsPath.empty() && 
+        !startMetrics(config.metricsPath, (MetricsFormat)config.metricsFormat, config.metricsIntervalSeconds)) {
+        return 1;
+    }
+    
+    uint64_t start = nowNanos();
+    benchmarkDeadline = config.durationSeconds > 0 
+                      ? start + (uint64_t)(config.durationSeconds * 1e9) : 0;
+    
+    trace.startNanos = start;
+    bool ran = (config.workers == 0) ? runThreadPerClient(threadStats, clients, workload)
+                                     : runWorkerPool(threadStats, tasks, workload, steals);
+    if (!ran) return 1;
+    uint64_t elapsed = nowNanos() - start;
+    uint64_t metricsDumps = 0;
+    bool metricsFailed = false;
+    if (metrics.enabled) {
+        stopMetrics();
+        metricsDumps = metrics.dumps;
+        metricsFailed = metrics.failed;
+    }
+    if (engine->stop != nullptr) engine->stop();
+    stopSnapshots();
+    stopAuditor();
+    uint64_t walRecords = min(wal.tail.load(), wal.capacity) - wal.recovered;
+    closeWal();
+    
+    uint64_t journalDropped = stopJournal();
+    if (journalOut != nullptr && journalOut != stdout) fclose(journalOut);
+    
+    ClientStats* total = new ClientStats();
+    for (ClientStats* stats : threadStats) total->merge(*stats);
+    // Every replayed record is timed, so the merged counts are the records replayed
+    uint64_t replayRecords = 0, replayMaxLag = 0;
+    for (int op = 0; op < OP_COUNT; op++) replayRecords += total->succeeded(op) + total->failed(op);
+    for (BenchmarkClient* client : clients) replayMaxLag = max(replayMaxLag, client->task.replayLagNanos);
+    for (const ClientTask& task : tasks) replayMaxLag = max(replayMaxLag, task.replayLagNanos);
+    trace.lanes.clear();
+    for (BenchmarkClient* client : clients) delete client;
+    destroyWorkerPool();
+    delete[] workload;
+    
+    printBenchmarkReport(*total, elapsed, openingTotal);
+    if (config.workers > 0) {
+        cout << "workers=" << config.workers << " steals=" << steals << endl;
+    }
+    if (!config.replayPath.empty()) {
+        cout << "replay=" << config.replayPath << " replay_records=" << replayRecords
+             << " replay_skipped=" << trace.skipped << " replay_speed=" << defaultfloat << config.replaySpeed
+             << " replay_max_lag_us=" << replayMaxLag / 1000 << endl;
+    }
+    if (engine == &ENGINES[ENGINE_SHARDED]) {
+        cout << "shards=" << config.shards << " shard_messages=" << shardSet.messages
+             << " cross_shard_transfers=" << shardSet.forwarded 
+             << " in_flight=" << formatMoney(shardSet.inFlight) << endl;
+    }
+    if (!config.walPath.empty()) {
+        cout << "wal_recovered=" << wal.recovered 
+             << " recovery_ms=" << wal.recoveryNanos / 1000000 << endl;
+        cout << "wal_records=" << walRecords << " wal_commits=" << wal.commits
+             << " records_per_commit=" << (wal.commits > 0 ? walRecords / wal.commits : 0)
+             << " msync_ms=" << wal.commitNanos / 1000000
+             << " wal_interval_us=" << config.walIntervalMicros << " wal_batch=" << config.walBatch
+             << " wal_sync=" << (config.walSync ? "yes" : "no")
+             << " wal_overflow=" << wal.overflow.load() << endl;
+    }
+    if (!config.loadSnapshotPath.empty()) {
+        cout << "snapshot_loaded=" << config.loadSnapshotPath << " load_ms=" << loadNanos / 1000000 << endl;
+    }
+    if (snapshots.periodic) {
+        cout << "snapshots=" << snapshots.taken 
+             << " snapshot_avg_us=" << snapshots.totalNanos / max((uint64_t)1, snapshots.taken) / 1000
+             << " snapshot_max_us=" << snapshots.maxNanos / 1000
+             << " snapshot_write_ms=" << snapshots.writeNanos / 1000000
+             << " cow_copies=" << snapshots.copies.load()
+             << " lock_wait_during_snapshots_us=" << snapshots.lockWaitNanos / 1000 
+             << (snapshots.failed ? " write_failed=yes" : "") << endl;
+    }
+    if (audit.enabled) {
+        cout << "audits=" << audit.audits
+             << " audit_avg_us=" << audit.totalNanos / max((uint64_t)1, audit.audits) / 1000
+             << " audit_max_us=" << audit.maxNanos / 1000
+             << " audit_violations=" << audit.violations << endl;
+    }
+    destroyAuditor();
+    destroySnapshots();
+    if (!config.metricsPath.empty()) {
+        cout << "metrics=" << config.metricsPath << " metrics_dumps=" << metricsDumps
+             << (metricsFailed ? " write_failed=yes" : "") << endl;
+    }
+    if (config.opWeights[OP_MULTI] > 0) {
+        cout << "multi_legs=" << config.multiLegs << endl;
+    }
+    if (engine == &ENGINES[ENGINE_OPTIMISTIC]) {
+        uint64_t txns, aborts, retried;
+        getOccTotals(txns, aborts, retried);
+        cout << "occ_txns=" << txns << " occ_aborts=" << aborts << " retried_txns=" << retried
+             << " abort_rate=" << fixed << setprecision(4) << (txns + aborts > 0 ? (double)aborts / (txns + aborts) : 0)
+             << " retry_rate=" << (txns > 0 ? (double)retried / txns : 0) << endl;
+    }
+    if (config.batchSize > 0) {
+        cout << "transfer_batch=" << config.batchSize << " transfer_batches=" << total->transferBatches
+             << " avg_batch=" << fixed << setprecision(1)
+             << (total->transferBatches > 0 ? (double)total->batchedTransfers / total->transferBatches : 0) << endl;
+    }
+    if (config.pregenerate) {
+        cout << "pregenerated_ops=" << (long long)config.numClients * config.transactionsPerClient
+             << " pregen_ms=" << pregenNanos / 1000000 << endl;
+    }
+    if (journalOut != nullptr) {
+        cout << "journal_records=" << journal.written << " journal_batches=" << journal.batches
+             << " journal_dropped=" << journalDropped << endl;
+    }
+    delete total;
+    
+    clearHistory();
+    clearOccStats();
+    destroyAccountStore(accounts);
+    return 0;
+}
+
+// Function to replay a write-ahead log into a fresh account store and report recovery speed
+int runRecovery() {
+    if (!mapWal(config.recoverPath, false, 0)) return 1;
+    config.numAccounts = (int)wal.header->numAccounts;
+    config.initialBalance = wal.header->initialBalance;
+    if (!initAccountStore(accounts, config.numAccounts, config.initialBalance, 
+                          (AccountLayout)config.accountLayout, (AccountNumbering)config.accountNumbering,
+                          (LockPolicy)config.lockPolicy)) {
+        cerr << "Error allocating " << config.numAccounts << " accounts" << endl;
+        return 1;
+    }
+    
+    uint64_t start = nowNanos();
+    uint64_t records = replayWal();
+    uint64_t elapsed = nowNanos() - start;
+    Reconciliation reconciliation = reconcileBalances(accounts);
+    double seconds = elapsed / 1e9;
+    
+    cout << "=== Recovery Report ===" << endl;
+    cout << "wal=" << config.recoverPath << " accounts=" << config.numAccounts
+         << " capacity=" << wal.capacity << " generation=" << wal.header->generation << endl;
+    cout << "recovered_records=" << records 
+         << " recovery_ms=" << elapsed / 1000000
+         << " records_per_sec=" << fixed << setprecision(0) << (seconds > 0 ? records / seconds : 0)
+         << " mb_per_sec=" << (seconds > 0 ? records * sizeof(WalRecord) / seconds / 1e6 : 0) << endl;
+    cout << "total_balance=" << formatMoney(reconciliation.total)
+         << " negative_balances=" << reconciliation.negativeCount
+         << " min_balance=" << formatMoney(reconciliation.minBalance) << endl;
+    
+    unmapWal();
+    destroyAccountStore(accounts);
+    return 0;
+}
+
+// Index benchmark thread: builds part of the index, then times its lookups
+struct IndexBenchThread {
+    pthread_t thread;
+    int id;
+    AccountIndex* index;
+    uint64_t count;             // accounts in the index
+    uint64_t lookups;
+    uint64_t lookupNanos;
+    uint64_t wrong;             // lookups that returned the wrong slot
+    atomic<int>* phase;         // 0 = build, 1 = lookup (raised by the main thread)
+};
+
+const int INDEX_BENCH_MISS_PERCENT = 10;
+
+// Function to draw an index benchmark query: a present account (expected is its slot) or,
+// INDEX_BENCH_MISS_PERCENT of the time, a number that is certainly absent (expected = -1)
+inline uint64_t indexBenchQuery(Xoshiro256& rng, uint64_t count, int& expected) {
+    uint64_t r = rng.next();
+    if (r % 100 < (uint64_t)INDEX_BENCH_MISS_PERCENT) {
+        expected = -1;
+        return sparseAccountNumber(count + 1 + (r >> 8) % count);
+    }
+    expected = (int)((r >> 8) % count);
+    return sparseAccountNumber((uint64_t)expected + 1);
+}
+
+// Index benchmark thread function
+void* indexBenchThread(void* arg) {
+    IndexBenchThread* self = (IndexBenchThread*)arg;
+    
+    // Concurrent build: each thread inserts an interleaved share of the accounts
+    for (uint64_t i = self->id; i < self->count; i += config.numClients) {
+        self->index->insert(sparseAccountNumber(i + 1), (int)i);
+    }
+    while (self->phase->load(memory_order_acquire) == 0) sched_yield();
+    
+    Xoshiro256 rng;
+    rng.seed(config.seed, self->id);
+    uint64_t start = nowNanos();
+    for (uint64_t n = 0; n < self->lookups; n++) {
+        int expected;
+        uint64_t number = indexBenchQuery(rng, self->count, expected);
+        if (self->index->find(number) != expected) self->wrong++;
+    }
+    self->lookupNanos = nowNanos() - start;
+    return nullptr;
+}
+
+// Function to benchmark the account-number index: concurrent build, then concurrent
+// lookups with sparse numbers (90% hits), compared with std::unordered_map on one thread
+int runIndexBenchmark() {
+    uint64_t count = (uint64_t)config.numAccounts;
+    AccountIndex index;
+    if (!initAccountIndex(index, count)) {
+        cerr << "Error allocating the index for " << count << " accounts" << endl;
+        return 1;
+    }
+    
+    atomic<int> phase(0);
+    vector<IndexBenchThread> threads(config.numClients);
+    uint64_t buildStart = nowNanos();
+    for (int t = 0; t < config.numClients; t++) {
+        threads[t].id = t;
+        threads[t].index = &index;
+        threads[t].count = count;
+        threads[t].lookups = (uint64_t)config.transactionsPerClient;
+        threads[t].lookupNanos = 0;
+        threads[t].wrong = 0;
+        threads[t].phase = &phase;
+        if (pthread_create(&threads[t].thread, nullptr, indexBenchThread, &threads[t]) != 0) {
+            cerr << "Error creating index benchmark thread " << t << endl;
+            return 1;
+        }
+    }
+    // The build is over once every account can be found
+    for (uint64_t i = 0; i < count; i++) {
+        while (index.find(sparseAccountNumber(i + 1)) != (int)i) sched_yield();
+    }
+    uint64_t buildNanos = nowNanos() - buildStart;
+    
+    uint64_t probeTotal = 0, probeMax = 0;
+    for (uint64_t i = 0; i <= index.mask; i++) {
+        uint64_t number = index.entries[i].number.load(memory_order_relaxed);
+        if (number == 0) continue;
+        uint64_t distance = (i - index.home(number)) & index.mask;
+        probeTotal += distance + 1;
+        probeMax = max(probeMax, distance + 1);
+    }
+    
+    uint64_t lookupStart = nowNanos();
+    phase.store(1, memory_order_release);
+    uint64_t lookups = 0, lookupNanos = 0, wrong = 0;
+    for (IndexBenchThread& thread : threads) {
+        pthread_join(thread.thread, nullptr);
+        lookups += thread.lookups;
+        lookupNanos += thread.lookupNanos;
+        wrong += thread.wrong;
+    }
+    uint64_t lookupWall = nowNanos() - lookupStart;
+    
+    // Baseline: the standard node-based hash map, built and queried on one thread
+    unordered_map<uint64_t, int> baseline;
+    baseline.reserve(count);
+    uint64_t baselineStart = nowNanos();
+    for (uint64_t i = 0; i < count; i++) baseline.emplace(sparseAccountNumber(i + 1), (int)i);
+    uint64_t baselineBuild = nowNanos() - baselineStart;
+    Xoshiro256 rng;
+    rng.seed(config.seed, 0);
+    uint64_t baselineLookups = (uint64_t)config.transactionsPerClient;
+    uint64_t baselineWrong = 0;
+    baselineStart = nowNanos();
+    for (uint64_t n = 0; n < baselineLookups; n++) {
+        int expected;
+        auto found = baseline.find(indexBenchQuery(rng, count, expected));
+        if ((found == baseline.end() ? -1 : found->second) != expected) baselineWrong++;
+    }
+    uint64_t baselineNanos = nowNanos() - baselineStart;
+    
+    cout << "=== Index Benchmark ===" << endl;
+    cout << "accounts=" << count << " capacity=" << index.mask + 1
+         << " load_factor=" << fixed << setprecision(2) << (double)count / (index.mask + 1)
+         << " index_mb=" << (index.mask + 1) * sizeof(AccountIndexEntry) / (1 << 20)
+         << " threads=" << config.numClients << " miss_percent=" << INDEX_BENCH_MISS_PERCENT << endl;
+    cout << "build_ms=" << buildNanos / 1000000
+         << " inserts_per_sec=" << setprecision(0) << count / (buildNanos / 1e9)
+         << " avg_probe=" << setprecision(2) << (double)probeTotal / max(count, (uint64_t)1)
+         << " max_probe=" << probeMax << endl;
+    cout << "lookups=" << lookups 
+         << " lookup_ns=" << setprecision(1) << (double)lookupNanos / max(lookups, (uint64_t)1)
+         << " lookups_per_sec=" << setprecision(0) << lookups / (lookupWall / 1e9)
+         << " wrong=" << wrong << endl;
+    cout << "unordered_map_build_ms=" << baselineBuild / 1000000
+         << " unordered_map_lookup_ns=" << setprecision(1) << (double)baselineNanos / max(baselineLookups, (uint64_t)1)
+         << " unordered_map_wrong=" << baselineWrong << endl;
+    
+    destroyAccountIndex(index);
+    return (wrong == 0 && baselineWrong == 0) ? 0 : 1;
+}
+
+// Function to print command-line usage
+void printUsage(const char* program) {
+    cout << "Usage: " << program << " [options]\n"
+         << "Without options the simulator runs interactively.\n"
+         << "Any option switches to headless benchmark mode:\n"
+         << "  --headless              run headless with default settings\n"
+         << "  --accounts N            number of accounts (default 1000)\n"
+         << "  --initial-balance X     initial balance per account (default 1000)\n"
+         << "  --clients N             number of client threads (default 8)\n"
+         << "  --transactions N        transactions per client (default 100000)\n"
+         << "  --min-amount X          minimum transaction amount (default 1)\n"
+         << "  --max-amount X          maximum transaction amount (default 100)\n"
+         << "  --mix D:W:T[:M[:B]]     deposit:withdraw:transfer:multi-leg:balance-inquiry\n"
+         << "                          weights (default 1:1:1:0:0)\n"
+         << "  --legs N                payees per multi-leg payment (default 16)\n"
+         << "  --seed N                random seed (default: current time); each client's\n"
+         << "                          operation stream depends only on the seed\n"
+         << "  --duration SECONDS      stop after this many seconds\n"
+         << "  --journal PATH          write a transaction journal to PATH (- = stdout)\n"
+         << "  --journal-format F      text, binary or csv (default text); binary and csv\n"
+         << "                          journals can be replayed with --replay\n"
+         << "  --journal-policy P      block or drop when a thread's ring is full (default block)\n"
+         << "  --journal-capacity N    records per thread ring (default 65536)\n"
+         << "  --layout L              account layout: packed or padded (default padded)\n"
+         << "  --account-numbers N     sequential (1, 2, 3, ...) or sparse 64-bit numbers\n"
+         << "                          (default sequential)\n"
+         << "  --index-bench           benchmark the account-number index with --accounts\n"
+         << "                          sparse numbers: --clients threads build it, then each\n"
+         << "                          does --transactions lookups; report and exit\n"
+         << "  --engine E              balance engine: mutex, atomic, sharded or optimistic\n"
+         << "                          (default mutex)\n"
+         << "  --lock P                per-account lock of the mutex engine: mutex, spin,\n"
+         << "                          adaptive (spin, then futex) or seqlock (lock-free\n"
+         << "                          balance reads) (default mutex)\n"
+         << "  --shards N              shard threads for the sharded engine (default one per core)\n"
+         << "  --history               keep per-account transaction history in arenas\n"
+         << "  --workers N             run clients on N work-stealing threads (auto = one per core,\n"
+         << "                          default 0 = one thread per client)\n"
+         << "  --pregen                generate all operations before the timed phase\n"
+         << "  --distribution D        account selection: uniform, zipf:THETA (0 < THETA < 1)\n"
+         << "                          or hotspot:ACCOUNTS_PCT:OPS_PCT (default uniform)\n"
+         << "  --batch N               execute transfers in batches of N with group locking\n"
+         << "                          (default 0 = one transfer at a time)\n"
+         << "  --wal PATH              durable mode: append every successful operation to a\n"
+         << "                          memory-mapped write-ahead log; an existing log is\n"
+         << "                          replayed first (mutex and sharded engines)\n"
+         << "  --wal-interval US       group commit interval in microseconds (default 1000)\n"
+         << "  --wal-batch N           also commit once N records are pending (default 0 = off)\n"
+         << "  --wal-capacity N        records to reserve for this run; an existing log grows\n"
+         << "                          to fit them after its own (default one per transaction)\n"
+         << "  --wal-sync              clients wait for the group commit covering each operation\n"
+         << "  --recover PATH          replay a write-ahead log, report recovery speed and exit\n"
+         << "  --snapshot PATH         write a consistent snapshot of all balances to PATH\n"
+         << "                          while clients run, and once more at the end (mutex engine)\n"
+         << "  --snapshot-interval S   seconds between snapshots (default 1)\n"
+         << "  --load-snapshot PATH    start from the balances in a snapshot file\n"
+         << "  --audit                 check total == opening + deposits - withdrawals while\n"
+         << "                          clients run and report violations (mutex engine)\n"
+         << "  --audit-interval S      seconds between audits (default 0.1)\n"
+         << "  --audit-trail N         recent transactions kept per thread to explain a\n"
+         << "                          violation (default 65536)\n"
+         << "  --metrics PATH          dump live ops/sec, latency percentiles per operation and\n"
+         << "                          outcome, and lock-wait time to PATH while clients run\n"
+         << "  --metrics-format F      json (one line per dump) or prometheus (default json)\n"
+         << "  --metrics-interval S    seconds between dumps (default 1)\n"
+         << "  --replay PATH           replay a binary or .csv journal instead of generating\n"
+         << "                          operations; recorded client c runs as client c % clients\n"
+         << "  --replay-speed X        replay at X times the recorded rate (default 0 = as\n"
+         << "                          fast as possible)\n"
+         << "  --help                  show this message\n";
+}
+
+// Function to parse a numeric option value, exiting on malformed input
+double parseNumber(const char* option, const char* value, double min, double max) {
+    char* end = nullptr;
+    double parsed = strtod(value, &end);
+    if (end == value || *end != '\0' || parsed < min || parsed > max) {
+        cerr << "Invalid value for --" << option << ": " << value << endl;
+        exit(1);
+    }
+    return parsed;
+}
+
+// Function to build the configuration from command-line flags
+Config parseCommandLine(int argc, char* argv[]) {
+    Config cfg = defaultHeadlessConfig();
+    bool transactionsGiven = false;
+    
+    static const option longOptions[] = {
+        { "headless",        no_argument,       nullptr, 'H' },
+        { "accounts",        required_argument, nullptr, 'a' },
+        { "initial-balance", required_argument, nullptr, 'b' },
+        { "clients",         required_argument, nullptr, 'c' },
+        { "transactions",    required_argument, nullptr, 't' },
+        { "min-amount",      required_argument, nullptr, 'm' },
+        { "max-amount",      required_argument, nullptr, 'M' },
+        { "mix",             required_argument, nullptr, 'x' },
+        { "seed",            required_argument, nullptr, 's' },
+        { "duration",        required_argument, nullptr, 'd' },
+        { "journal",         required_argument, nullptr, 'j' },
+        { "journal-format",  required_argument, nullptr, 'f' },
+        { "journal-policy",  required_argument, nullptr, 'p' },
+        { "journal-capacity", required_argument, nullptr, 'q' },
+        { "layout",          required_argument, nullptr, 'L' },
+        { "account-numbers", required_argument, nullptr, 'N' },
+        { "index-bench",     no_argument,       nullptr, 'X' },
+        { "engine",          required_argument, nullptr, 'e' },
+        { "lock",            required_argument, nullptr, 'Q' },
+        { "history",         no_argument,       nullptr, 'y' },
+        { "workers",         required_argument, nullptr, 'w' },
+        { "pregen",          no_argument,       nullptr, 'g' },
+        { "distribution",    required_argument, nullptr, 'D' },
+        { "batch",           required_argument, nullptr, 'B' },
+        { "shards",          required_argument, nullptr, 'S' },
+        { "legs",            required_argument, nullptr, 'l' },
+        { "wal",             required_argument, nullptr, 'W' },
+        { "wal-interval",    required_argument, nullptr, 'I' },
+        { "wal-batch",       required_argument, nullptr, 'G' },
+        { "wal-capacity",    required_argument, nullptr, 'C' },
+        { "wal-sync",        no_argument,       nullptr, 'Y' },
+        { "recover",         required_argument, nullptr, 'R' },
+        { "snapshot",        required_argument, nullptr, 'P' },
+        { "snapshot-interval", required_argument, nullptr, 'V' },
+        { "load-snapshot",   required_argument, nullptr, 'O' },
+        { "audit",           no_argument,       nullptr, 'A' },
+        { "audit-interval",  required_argument, nullptr, 'i' },
+        { "audit-trail",     required_argument, nullptr, 'T' },
+        { "metrics",         required_argument, nullptr, 'k' },
+        { "metrics-format",  required_argument, nullptr, 'F' },
+        { "metrics-interval", required_argument, nullptr, 'K' },
+        { "replay",          required_argument, nullptr, 'r' },
+        { "replay-speed",    required_argument, nullptr, 'u' },
+        { "help",            no_argument,       nullptr, 'h' },
+        { nullptr, 0, nullptr, 0 }
+    };
+    
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+        switch (opt) {
+            case 'H': break;
+            case 'a': cfg.numAccounts = (int)parseNumber("accounts", optarg, 1, INT_MAX); break;
+            case 'b': cfg.initialBalance = toMoney(parseNumber("initial-balance", optarg, 0, 1e13)); break;
+            case 'c': cfg.numClients = (int)parseNumber("clients", optarg, 1, INT_MAX); break;
+            case 't':
+                cfg.transactionsPerClient = (long long)parseNumber("transactions", optarg, 1, 1e18);
+                transactionsGiven = true;
+                break;
+            case 'm': cfg.minAmount = toMoney(parseNumber("min-amount", optarg, 0.01, 1e13)); break;
+            case 'M': cfg.maxAmount = toMoney(parseNumber("max-amount", optarg, 0.01, 1e13)); break;
+            case 'x': {
+                cfg.opWeights[OP_MULTI] = 0;
+                cfg.opWeights[OP_BALANCE_INQUIRY] = 0;
+                int parsed = sscanf(optarg, "%d:%d:%d:%d:%d", &cfg.opWeights[OP_DEPOSIT], &cfg.opWeights[OP_WITHDRAW],
+                                    &cfg.opWeights[OP_TRANSFER], &cfg.opWeights[OP_MULTI],
+                                    &cfg.opWeights[OP_BALANCE_INQUIRY]);
+                int totalWeight = 0;
+                bool valid = (parsed >= 3 && parsed <= 5);
+                for (int op = 0; op < OP_COUNT; op++) {
+                    if (cfg.opWeights[op] < 0) valid = false;
+                    totalWeight += cfg.opWeights[op];
+                }
+                if (!valid || totalWeight == 0) {
+                    cerr << "Invalid value for --mix: " << optarg << endl;
+                    exit(1);
+                }
+                break;
+            }
+            case 's': cfg.seed = (unsigned int)parseNumber("seed", optarg, 0, UINT_MAX); break;
+            case 'd': cfg.durationSeconds = parseNumber("duration", optarg, 0, 1e9); break;
+            case 'j': cfg.journalPath = optarg; break;
+            case 'f':
+                if (strcmp(optarg, "text") == 0) cfg.journalFormat = JOURNAL_TEXT;
+                else if (strcmp(optarg, "binary") == 0) cfg.journalFormat = JOURNAL_BINARY;
+                else if (strcmp(optarg, "csv") == 0) cfg.journalFormat = JOURNAL_CSV;
+                else {
+                    cerr << "Invalid value for --journal-format: " << optarg << endl;
+                    exit(1);
+                }
+                break;
+            case 'p':
+                if (strcmp(optarg, "block") == 0) cfg.journalPolicy = JOURNAL_BLOCK;
+                else if (strcmp(optarg, "drop") == 0) cfg.journalPolicy = JOURNAL_DROP;
+                else {
+                    cerr << "Invalid value for --journal-policy: " << optarg << endl;
+                    exit(1);
+                }
+                break;
+            case 'N':
+                if (strcmp(optarg, "sequential") == 0) cfg.accountNumbering = ACCOUNT_NUMBERS_SEQUENTIAL;
+                else if (strcmp(optarg, "sparse") == 0) cfg.accountNumbering = ACCOUNT_NUMBERS_SPARSE;
+                else {
+                    cerr << "Invalid value for --account-numbers: " << optarg << endl;
+                    exit(1);
+                }
+                break;
+            case 'X': cfg.indexBenchmark = true; break;
+            case 'L':
+                if (strcmp(optarg, "packed") == 0) cfg.accountLayout = LAYOUT_PACKED;
+                else if (strcmp(optarg, "padded") == 0) cfg.accountLayout = LAYOUT_PADDED;
+                else {
+                    cerr << "Invalid value for --layout: " << optarg << endl;
+                    exit(1);
+                }
+                break;
+            case 'y': cfg.recordHistory = true; break;
+            case 'g': cfg.pregenerate = true; break;
+            case 'B': cfg.batchSize = (int)parseNumber("batch", optarg, 0, 1 << 20); break;
+            case 'S': cfg.shards = (int)parseNumber("shards", optarg, 1, 65536); break;
+            case 'l': cfg.multiLegs = (int)parseNumber("legs", optarg, 1, 4096); break;
+            case 'W': cfg.walPath = optarg; break;
+            case 'I': cfg.walIntervalMicros = parseNumber("wal-interval", optarg, 0, 1e9); break;
+            case 'G': cfg.walBatch = (uint64_t)parseNumber("wal-batch", optarg, 0, 1e15); break;
+            case 'C': cfg.walCapacity = (uint64_t)parseNumber("wal-capacity", optarg, 1, 1e15); break;
+            case 'Y': cfg.walSync = true; break;
+            case 'R': cfg.recoverPath = optarg; break;
+            case 'k': cfg.metricsPath = optarg; break;
+            case 'F':
+                if (strcmp(optarg, "json") == 0) cfg.metricsFormat = METRICS_JSON;
+                else if (strcmp(optarg, "prometheus") == 0) cfg.metricsFormat = METRICS_PROMETHEUS;
+                else {
+                    cerr << "Invalid value for --metrics-format: " << optarg << endl;
+                    exit(1);
+                }
+                break;
+            case 'r': cfg.replayPath = optarg; break;
+            case 'u': cfg.replaySpeed = parseNumber("replay-speed", optarg, 0, 1e9); break;
+            case 'K': cfg.metricsIntervalSeconds = parseNumber("metrics-interval", optarg, 0.001, 1e9); break;
+            case 'P': cfg.snapshotPath = optarg; break;
+            case 'V': cfg.snapshotIntervalSeconds = parseNumber("snapshot-interval", optarg, 0.001, 1e9); break;
+            case 'O': cfg.loadSnapshotPath = optarg; break;
+            case 'A': cfg.audit = true; break;
+            case 'i': cfg.auditIntervalSeconds = parseNumber("audit-interval", optarg, 0.001, 1e9); break;
+            case 'T': {
+                uint64_t capacity = (uint64_t)parseNumber("audit-trail", optarg, 2, 1 << 30);
+                cfg.auditTrailCapacity = 1;
+                while (cfg.auditTrailCapacity < capacity) cfg.auditTrailCapacity <<= 1;
+                break;
+            }
+            case 'D':
+                if (strcmp(optarg, "uniform") == 0) {
+                    cfg.distribution = DIST_UNIFORM;
+                } else if (sscanf(optarg, "zipf:%lf", &cfg.zipfTheta) == 1 && 
+                           cfg.zipfTheta > 0 && cfg.zipfTheta < 1) {
+                    cfg.distribution = DIST_ZIPF;
+                } else if (sscanf(optarg, "hotspot:%lf:%lf", &cfg.hotspotAccountsPercent, 
+                                  &cfg.hotspotOpsPercent) == 2 &&
+                           cfg.hotspotAccountsPercent > 0 && cfg.hotspotAccountsPercent <= 100 &&
+                           cfg.hotspotOpsPercent >= 0 && cfg.hotspotOpsPercent <= 100) {
+                    cfg.distribution = DIST_HOTSPOT;
+                } else {
+                    cerr << "Invalid value for --distribution: " << optarg << endl;
+                    exit(1);
+                }
+                break;
+            case 'w':
+                if (strcmp(optarg, "auto") == 0) cfg.workers = (int)max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+                else cfg.workers = (int)parseNumber("workers", optarg, 0, 65536);
+                break;
+            case 'e': {
+                cfg.engine = -1;
+                for (int e = 0; e < ENGINE_COUNT; e++) {
+                    if (strcmp(optarg, ENGINES[e].name) == 0) cfg.engine = e;
+                }
+                if (cfg.engine < 0) {
+                    cerr << "Invalid value for --engine: " << optarg << endl;
+                    exit(1);
+                }
+                break;
+            }
+            case 'Q': {
+                cfg.lockPolicy = -1;
+                for (int policy = 0; policy < LOCK_POLICY_COUNT; policy++) {
+                    if (strcmp(optarg, LOCK_POLICY_NAMES[policy]) == 0) cfg.lockPolicy = policy;
+                }
+                if (cfg.lockPolicy < 0) {
+                    cerr << "Invalid value for --lock: " << optarg << endl;
+                    exit(1);
+                }
+                break;
+            }
+            case 'q': {
+                uint64_t capacity = (uint64_t)parseNumber("journal-capacity", optarg, 2, 1 << 30);
+                cfg.journalCapacity = 1;
+                while (cfg.journalCapacity < capacity) cfg.journalCapacity <<= 1;
+                break;
+            }
+            case 'h':
+                printUsage(argv[0]);
+                exit(0);
+            default:
+                printUsage(argv[0]);
+                exit(1);
+        }
+    }
+    
+    if (optind < argc) {
+        cerr << "Unexpected argument: " << argv[optind] << endl;
+        exit(1);
+    }
+    if (cfg.maxAmount < cfg.minAmount) {
+        cerr << "--max-amount must be >= --min-amount" << endl;
+        exit(1);
+    }
+    if (!cfg.walPath.empty() && cfg.engine != ENGINE_MUTEX && cfg.engine != ENGINE_SHARDED) {
+        cerr << "--wal needs the mutex or sharded engine (the others have no critical "
+                "section to log in)" << endl;
+        exit(1);
+    }
+    if (cfg.lockPolicy != LOCK_MUTEX && cfg.engine != ENGINE_MUTEX) {
+        cerr << "--lock applies to the mutex engine (the others take no account locks)" << endl;
+        exit(1);
+    }
+    if (cfg.opWeights[OP_MULTI] > 0 && ENGINES[cfg.engine].multiTransfer == nullptr) {
+        cerr << "Multi-leg payments need the mutex or optimistic engine" << endl;
+        exit(1);
+    }
+    if (cfg.opWeights[OP_MULTI] > 0 && !cfg.walPath.empty()) {
+        cerr << "--wal does not log multi-leg payments" << endl;
+        exit(1);
+    }
+    if (!cfg.replayPath.empty() && (cfg.pregenerate || cfg.batchSize > 0)) {
+        cerr << "--replay runs the recorded operations and cannot be combined with --pregen or --batch" << endl;
+        exit(1);
+    }
+    if (!cfg.snapshotPath.empty() && cfg.engine != ENGINE_MUTEX) {
+        cerr << "--snapshot needs the mutex engine (snapshots copy balances under the account locks)" << endl;
+        exit(1);
+    }
+    if (cfg.audit && cfg.engine != ENGINE_MUTEX) {
+        cerr << "--audit needs the mutex engine (it reads balances through snapshot cuts)" << endl;
+        exit(1);
+    }
+    if (!cfg.loadSnapshotPath.empty() && !cfg.walPath.empty()) {
+        cerr << "--load-snapshot and --wal cannot be combined (the log replays onto its own opening balances)" 
+             << endl;
+        exit(1);
+    }
+    if (!cfg.walPath.empty() && cfg.walCapacity == 0 && cfg.durationSeconds > 0 && !transactionsGiven) {
+        cerr << "--wal needs --wal-capacity or --transactions when --duration is given" << endl;
+        exit(1);
+    }
+    // A duration without an explicit transaction count means "run until time is up"
+    if (cfg.durationSeconds > 0 && !transactionsGiven) {
+        if (cfg.pregenerate) {
+            cerr << "--pregen needs --transactions when --duration is given" << endl;
+            exit(1);
+        }
+        cfg.transactionsPerClient = LLONG_MAX;
+    }
+    
+    return cfg;
 }
 
-int main() {
-    srand(time(nullptr));
+int main(int argc, char* argv[]) {
+    if (argc > 1) {
+        config = parseCommandLine(argc, argv);
+        engine = &ENGINES[config.engine];
+        history.enabled = config.recordHistory;
+        if (!config.recoverPath.empty()) return runRecovery();
+        if (config.indexBenchmark) return runIndexBenchmark();
+        return runBenchmark();
+    }
     
     // Get user configuration
     config = getUserConfig();
+    history.enabled = config.recordHistory;
     
     // Clear screen and show initialization
     clearScreen();
@@ -451,18 +2192,26 @@ int main() {
     cout << endl;
     
     // Initialize bank accounts
+    if (!initAccountStore(accounts, config.numAccounts, config.initialBalance, 
+                          (AccountLayout)config.accountLayout, (AccountNumbering)config.accountNumbering,
+                          (LockPolicy)config.lockPolicy)) {
+        cerr << Colors::RED << "❌ Error allocating accounts" << Colors::RESET << endl;
+        return 1;
+    }
+    initAccountPicker(accountPicker, accounts.size());
     for (int i = 0; i < config.numAccounts; i++) {
-        BankAccount acc;
-        acc.accountNumber = i + 1;
-        acc.balance = config.initialBalance;
-        pthread_mutex_init(&acc.lock, nullptr);
-        accounts.push_back(acc);
-        
-        cout << Colors::GREEN << "  ✓ " << Colors::RESET 
-             << "Account " << Colors::BRIGHT_CYAN << acc.accountNumber << Colors::RESET
-             << " initialized with balance: " << Colors::BRIGHT_GREEN 
-             << "$" << fixed << setprecision(2) << config.initialBalance << Colors::RESET << endl;
-        usleep(100000); // Small delay for visual effect
+        // Only the first few accounts are announced, so large runs start quickly
+        if (i < 10) {
+            cout << Colors::GREEN << "  ✓ " << Colors::RESET 
+                 << "Account " << Colors::BRIGHT_CYAN << accounts.accountNumber(i) << Colors::RESET
+                 << " initialized with balance: " << Colors::BRIGHT_GREEN 
+                 << "$" << formatMoney(config.initialBalance) << Colors::RESET << endl;
+            usleep(100000); // Small delay for visual effect
+        }
+    }
+    if (config.numAccounts > 10) {
+        cout << Colors::GREEN << "  ✓ " << Colors::RESET << "... and " << (config.numAccounts - 10)
+             << " more account(s)" << endl;
     }
     
     cout << "\n" << Colors::BRIGHT_YELLOW << "  ⏳ Starting " << config.numClients 
@@ -473,13 +2222,19 @@ int main() {
     printSeparator("LIVE TRANSACTION LOG");
     cout << endl;
     
+    // The journal writer owns all console output while clients run
+    if (!startJournal(stdout, JOURNAL_TEXT_COLOR, JOURNAL_BLOCK, config.journalCapacity)) {
+        cerr << Colors::RED << "❌ Error creating journal writer thread" << Colors::RESET << endl;
+        return 1;
+    }
+    
     // Create client threads
     pthread_t* threads = new pthread_t[config.numClients];
-    int* clientIds = new int[config.numClients];
+    ClientTask* clientTasks = new ClientTask[config.numClients];
     
     for (int i = 0; i < config.numClients; i++) {
-        clientIds[i] = i + 1;
-        if (pthread_create(&threads[i], nullptr, clientThread, &clientIds[i]) != 0) {
+        initClientTask(clientTasks[i], i + 1, nullptr);
+        if (pthread_create(&threads[i], nullptr, clientThread, &clientTasks[i]) != 0) {
             cerr << Colors::RED << "❌ Error creating thread " << i << Colors::RESET << endl;
             return 1;
         }
@@ -493,18 +2248,18 @@ int main() {
         }
     }
     
+    stopJournal();
+    
     // Print final report
     printFinalReport();
     
     // Cleanup mutexes
-    for (auto& acc : accounts) {
-        pthread_mutex_destroy(&acc.lock);
-    }
-    pthread_mutex_destroy(&logMutex);
+    clearHistory();
+    destroyAccountStore(accounts);
     pthread_mutex_destroy(&progressMutex);
     
     delete[] threads;
-    delete[] clientIds;
+    delete[] clientTasks;
     
     cout << "\n" << Colors::BRIGHT_GREEN << Colors::BOLD 
          << "  ✨ Simulation completed successfully! ✨" << Colors::RESET << endl;
@@ -512,4 +2267,3 @@ int main() {
     
     return 0;
 }
-
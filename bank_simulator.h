@@ -0,0 +1,656 @@
+// Bank engine library: the account store, the balance engines and the
+// configuration they run under. bank_engine.cpp implements it; the simulator
+// (bank_simulator.cpp), the benchmarks and other programs link the engine and
+// drive deposit(), withdraw(), transfer() and logTransaction() directly.
+#ifndef BANK_SIMULATOR_H
+#define BANK_SIMULATOR_H
+
+#include <pthread.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// ANSI Color Codes for beautiful terminal output
+namespace Colors {
+    const std::string RESET = "\033[0m";
+    const std::string BOLD = "\033[1m";
+    const std::string DIM = "\033[2m";
+    
+    // Text Colors
+    const std::string RED = "\033[31m";
+    const std::string GREEN = "\033[32m";
+    const std::string YELLOW = "\033[33m";
+    const std::string BLUE = "\033[34m";
+    const std::string MAGENTA = "\033[35m";
+    const std::string CYAN = "\033[36m";
+    const std::string WHITE = "\033[37m";
+    
+    // Background Colors
+    const std::string BG_BLUE = "\033[44m";
+    const std::string BG_GREEN = "\033[42m";
+    const std::string BG_YELLOW = "\033[43m";
+    const std::string BG_RED = "\033[41m";
+    const std::string BG_CYAN = "\033[46m";
+    
+    // Bright Colors
+    const std::string BRIGHT_GREEN = "\033[92m";
+    const std::string BRIGHT_YELLOW = "\033[93m";
+    const std::string BRIGHT_BLUE = "\033[94m";
+    const std::string BRIGHT_MAGENTA = "\033[95m";
+    const std::string BRIGHT_CYAN = "\033[96m";
+}
+
+// Money is a 64-bit fixed-point count of cents: arithmetic is exact and
+// balances can be updated with plain integer atomics.
+typedef int64_t Money;
+
+const Money CENTS_PER_DOLLAR = 100;
+
+// Operation types used for the op mix and per-operation statistics
+enum OpType {
+    OP_DEPOSIT = 0,
+    OP_WITHDRAW,
+    OP_TRANSFER,
+    OP_MULTI,       // one payer pays the same amount to several payees, all or nothing
+    OP_BALANCE_INQUIRY, // read-only: reads one account's balance
+    OP_COUNT
+};
+
+const char* const OP_NAMES[OP_COUNT] = { "deposit", "withdraw", "transfer", "multi", "balance" };
+
+// How an operation ended; failed withdrawals and failed transfers are told apart the
+// same way the transaction log tells them apart
+enum Outcome {
+    OUTCOME_OK,
+    OUTCOME_INSUFFICIENT_FUNDS,     // withdrawal refused
+    OUTCOME_TRANSFER_FAILED,        // transfer or multi-leg payment refused
+    OUTCOME_REFUSED,                // refused because the write-ahead log was full
+    OUTCOME_COUNT
+};
+
+const char* const OUTCOME_NAMES[OUTCOME_COUNT] = { "ok", "insufficient_funds", "transfer_failed", "refused" };
+
+inline Outcome outcomeOf(int op, bool success, bool refused = false) {
+    if (success) return OUTCOME_OK;
+    if (refused) return OUTCOME_REFUSED;
+    return (op == OP_WITHDRAW || op == OP_DEPOSIT) ? OUTCOME_INSUFFICIENT_FUNDS : OUTCOME_TRANSFER_FAILED;
+}
+
+// Journal output formats
+enum JournalFormat {
+    JOURNAL_TEXT_COLOR = 0,  // live colored log (interactive mode)
+    JOURNAL_TEXT,            // plain text, one line per record
+    JOURNAL_BINARY,          // raw JournalRecord structs
+    JOURNAL_CSV              // client,op,from,to,amount,timestamp (replayable trace)
+};
+
+enum JournalPolicy {
+    JOURNAL_BLOCK = 0,  // producers wait for free space when their ring is full
+    JOURNAL_DROP        // producers discard the record and count it as dropped
+};
+
+// Distribution used to pick accounts
+enum AccountDistribution {
+    DIST_UNIFORM = 0,
+    DIST_ZIPF,        // rank r (0 = hottest) is picked with probability ~ 1 / (r + 1)^theta
+    DIST_HOTSPOT      // a fixed share of picks goes to a small set of hot accounts
+};
+
+// Metrics dump formats
+enum MetricsFormat {
+    METRICS_JSON,
+    METRICS_PROMETHEUS
+};
+
+// Configuration structure
+struct Config {
+    int numAccounts;
+    Money initialBalance;
+    int numClients;
+    long long transactionsPerClient;
+    Money minAmount;
+    Money maxAmount;
+    
+    // Headless benchmark settings (set from the command line)
+    bool headless;
+    int opWeights[OP_COUNT];    // relative weights of deposit/withdraw/transfer/multi/balance
+    unsigned int seed;
+    double durationSeconds;     // 0 = run until every client finishes its transactions
+    
+    // Journal settings
+    std::string journalPath;    // empty = no journal, "-" = stdout
+    int journalFormat;          // JournalFormat
+    int journalPolicy;          // JournalPolicy
+    uint64_t journalCapacity;   // records per thread ring (power of two)
+    
+    int accountLayout;          // AccountLayout
+    int accountNumbering;       // AccountNumbering
+    bool indexBenchmark;        // benchmark the account-number index and exit
+    int engine;                 // EngineType
+    int lockPolicy;             // LockPolicy of the per-account locks
+    bool recordHistory;         // keep per-account transaction history
+    int workers;                // worker pool size, 0 = one thread per client
+    bool pregenerate;           // build every client's op stream before the timed phase
+    
+    // Account selection
+    int distribution;           // AccountDistribution
+    double zipfTheta;
+    double hotspotAccountsPercent;
+    double hotspotOpsPercent;
+    
+    int batchSize;              // transfers per batch, 0 = execute transfers one at a time
+    int shards;                 // shard threads for the sharded engine
+    int multiLegs;              // payees per multi-leg payment
+    
+    // Write-ahead log settings
+    std::string walPath;        // empty = no WAL
+    std::string recoverPath;    // replay this WAL, report and exit
+    double walIntervalMicros;   // group commit interval
+    uint64_t walBatch;          // commit early once this many records are pending (0 = interval only)
+    uint64_t walCapacity;       // records pre-allocated in a new segment (0 = one per transaction)
+    bool walSync;               // clients wait for the group commit covering their operation
+    
+    // Snapshot settings
+    std::string snapshotPath;   // empty = no online snapshots
+    double snapshotIntervalSeconds;
+    std::string loadSnapshotPath; // start from these balances instead of initialBalance
+    
+    // Auditor settings
+    bool audit;                 // check conservation of money while clients run
+    double auditIntervalSeconds;
+    uint64_t auditTrailCapacity; // recent transactions kept per thread (power of two)
+    
+    // Metrics settings
+    std::string metricsPath;    // empty = no metrics dump
+    int metricsFormat;          // MetricsFormat
+    double metricsIntervalSeconds;
+    
+    // Replay settings
+    std::string replayPath;     // empty = generate the workload
+    double replaySpeed;         // 0 = as fast as possible, 1 = recorded rate
+};
+
+// Reference to a Transaction inside the history arenas (see TransactionArena)
+typedef uint64_t TxnRef;
+
+const TxnRef NO_TXN = UINT64_MAX;
+
+// Transaction record structure: packed POD, 40 bytes, no heap allocation
+struct Transaction {
+    uint64_t timestamp;   // wall clock, nanoseconds since the epoch
+    Money amount;
+    Money balanceAfter;
+    TxnRef previous;      // previous transaction of the same account, or NO_TXN
+    int32_t clientId;
+    uint8_t op;           // OpType
+    uint8_t reserved[3];
+};
+
+// Memory layout of the hot account arrays
+enum AccountLayout {
+    LAYOUT_PACKED = 0,  // balances and locks stored back to back
+    LAYOUT_PADDED       // every balance and every lock on its own cache line
+};
+
+const size_t CACHE_LINE_SIZE = 64;
+
+// How the per-account locks are implemented (used by the mutex engine and snapshot cuts)
+enum LockPolicy {
+    LOCK_MUTEX = 0,     // pthread_mutex_t: parks in the kernel as soon as the lock is taken
+    LOCK_SPIN,          // test-and-test-and-set spinlock with exponential backoff
+    LOCK_ADAPTIVE,      // spins briefly, then sleeps on a futex
+    LOCK_SEQLOCK,       // writers spin on a sequence word; balance reads take no lock
+    LOCK_POLICY_COUNT
+};
+
+const char* const LOCK_POLICY_NAMES[LOCK_POLICY_COUNT] = { "mutex", "spin", "adaptive", "seqlock" };
+
+// Per-account contention counters (cold; only written when an access had to wait)
+struct AccountContention {
+    std::atomic<uint64_t> blocked;    // lock acquisitions that found the lock taken, or CAS retries
+    std::atomic<uint64_t> waitNanos;  // time spent waiting for the lock
+};
+
+// How account numbers are assigned to slots
+enum AccountNumbering {
+    ACCOUNT_NUMBERS_SEQUENTIAL = 0,  // slot i is account i + 1
+    ACCOUNT_NUMBERS_SPARSE           // scattered 64-bit numbers, as in a real bank
+};
+
+// One index entry (16 bytes, four per cache line). number == 0 means empty; slot is -1
+// between the moment an insert claims the entry and the moment it publishes the slot.
+struct AccountIndexEntry {
+    std::atomic<uint64_t> number;
+    std::atomic<int32_t> slot;
+    int32_t reserved;
+};
+
+// Open-addressing hash index from account number to slot (linear probing, Fibonacci
+// hashing). Readers never lock or write: a lookup is a few acquire loads along one probe
+// run. Inserts claim an empty entry with a CAS on its number and then publish the slot,
+// so they can run concurrently with each other and with lookups. Accounts are never
+// removed, and the capacity is fixed when the index is created (load factor <= 2/3).
+struct AccountIndex {
+    AccountIndexEntry* entries;
+    uint64_t mask;
+    int shift;
+    
+    AccountIndex() : entries(nullptr), mask(0), shift(64) {}
+    
+    uint64_t home(uint64_t number) const { return (number * 0x9E3779B97F4A7C15ULL) >> shift; }
+    
+    // Returns the slot of number, or -1 if it is not (yet) in the index
+    int find(uint64_t number) const {
+        for (uint64_t i = home(number); ; i = (i + 1) & mask) {
+            uint64_t key = entries[i].number.load(std::memory_order_acquire);
+            if (key == number) return entries[i].slot.load(std::memory_order_acquire);
+            if (key == 0) return -1;
+        }
+    }
+    
+    // Returns false if number is already present (or is 0, which marks empty entries)
+    bool insert(uint64_t number, int slot) {
+        if (number == 0) return false;
+        for (uint64_t i = home(number); ; i = (i + 1) & mask) {
+            uint64_t key = entries[i].number.load(std::memory_order_acquire);
+            if (key == 0 && entries[i].number.compare_exchange_strong(key, number, std::memory_order_acq_rel)) {
+                entries[i].slot.store(slot, std::memory_order_release);
+                return true;
+            }
+            if (key == number) return false;
+        }
+    }
+};
+
+// Account store (structure of arrays). Balances and locks live in separate
+// cache-line-aligned arrays that are allocated once and never move; the
+// transaction history is kept in a separate cold region.
+struct AccountStore {
+    int count;
+    AccountLayout layout;
+    LockPolicy lockPolicy;
+    size_t balanceStride;
+    size_t lockStride;
+    char* balanceBase;
+    char* lockBase;
+    uint64_t* accountNumbers;
+    AccountIndex numberIndex;       // account number -> slot
+    std::atomic<TxnRef>* historyHeads;  // newest transaction per account (cold)
+    AccountContention* contention;  // cold
+    char* versionBase;              // optimistic engine only, same stride as balances
+    
+    AccountStore() : count(0), layout(LAYOUT_PADDED), lockPolicy(LOCK_MUTEX), balanceStride(0), lockStride(0),
+                     balanceBase(nullptr), lockBase(nullptr), accountNumbers(nullptr),
+                     historyHeads(nullptr), contention(nullptr), versionBase(nullptr) {}
+    
+    size_t size() const { return (size_t)count; }
+    // Balances are atomic so the lock-free engine can use them directly; the mutex
+    // engine accesses them with relaxed loads and stores under the account lock.
+    std::atomic<Money>& balance(int index) { return *(std::atomic<Money>*)(balanceBase + index * balanceStride); }
+    pthread_mutex_t* lock(int index) { return (pthread_mutex_t*)(lockBase + index * lockStride); }
+    // Lock word of the spin, adaptive and seqlock policies (odd while a writer holds it)
+    std::atomic<uint32_t>& lockWord(int index) { return *(std::atomic<uint32_t>*)(lockBase + index * lockStride); }
+    uint64_t accountNumber(int index) const { return accountNumbers[index]; }
+    int findAccount(uint64_t number) const { return numberIndex.find(number); }
+    std::atomic<TxnRef>& historyHead(int index) { return historyHeads[index]; }
+    std::atomic<uint64_t>& version(int index) { return *(std::atomic<uint64_t>*)(versionBase + index * balanceStride); }
+};
+
+// A transfer submitted as part of a batch
+struct TransferRequest {
+    int32_t fromIndex;
+    int32_t toIndex;
+    Money amount;
+};
+
+// Per-item outcome of a batch
+struct TransferResult {
+    bool success;
+    bool refused;               // failed because the write-ahead log was full
+    Money fromBalanceAfter;
+    Money toBalanceAfter;
+};
+
+// Balance engines selectable at runtime
+enum EngineType {
+    ENGINE_MUTEX = 0,
+    ENGINE_ATOMIC,
+    ENGINE_SHARDED,
+    ENGINE_OPTIMISTIC,
+    ENGINE_COUNT
+};
+
+struct Engine {
+    const char* name;
+    bool (*deposit)(int clientId, int accountIndex, Money amount);
+    bool (*withdraw)(int clientId, int accountIndex, Money amount);
+    bool (*transfer)(int clientId, int fromAccountIndex, int toAccountIndex, Money amount);
+    int (*transferBatch)(int clientId, const TransferRequest* requests, int count, TransferResult* results);
+    // optional: atomic multi-leg payment (nullptr if the engine cannot make one atomic)
+    bool (*multiTransfer)(int clientId, int payerIndex, const int32_t* payees, int count, Money amount);
+    Money (*balance)(int accountIndex);
+    bool (*start)();            // optional: start engine threads before the clients run
+    void (*stop)();             // optional: stop them once every client has finished
+};
+
+extern const Engine ENGINES[ENGINE_COUNT];
+extern const Engine* engine;     // engine in use
+extern Config config;
+extern AccountStore accounts;
+
+// Function to convert a dollar amount (user input) to Money
+Money toMoney(double dollars);
+
+// Function to format Money as dollars and cents, e.g. -1234 -> "-12.34"
+std::string formatMoney(Money value);
+
+// Monotonic clock in nanoseconds, used for benchmark timing
+uint64_t nowNanos();
+
+// Function to allocate a cache-line-aligned, zeroed array
+char* allocateAligned(size_t bytes);
+
+// Function to scramble a slot's sequence number into a sparse account number
+uint64_t sparseAccountNumber(uint64_t sequence);
+
+// Function to size an index for count accounts; returns false if the allocation fails
+bool initAccountIndex(AccountIndex& index, size_t count);
+
+// Function to release an index
+void destroyAccountIndex(AccountIndex& index);
+
+// Function to create all accounts in place; locks are initialized where they will live
+bool initAccountStore(AccountStore& store, int count, Money initialBalance, AccountLayout layout,
+                      AccountNumbering numbering, LockPolicy lockPolicy);
+
+// Function to destroy the locks and release the store
+void destroyAccountStore(AccountStore& store);
+
+// Mutex engine operations (the entries of ENGINES[ENGINE_MUTEX])
+bool deposit(int clientId, int accountIndex, Money amount);
+bool withdraw(int clientId, int accountIndex, Money amount);
+bool transfer(int clientId, int fromAccountIndex, int toAccountIndex, Money amount);
+
+// Function to read a balance on the configured engine and log the inquiry
+bool balanceInquiry(int clientId, int accountIndex);
+
+// Function to log a transaction to the account history and the journal (when enabled);
+// refused marks a failure caused by a full write-ahead log rather than by the balance
+void logTransaction(int clientId, OpType op, bool success, int accountIndex, int toAccountIndex,
+                    Money amount, Money balanceAfter, Money toBalanceAfter = 0, bool refused = false);
+
+// Function to get the headless defaults (what the command line starts from)
+Config defaultHeadlessConfig();
+
+// Function to set up the accounts, history, journal (when cfg.journalPath is set) and engine
+// for cfg without starting any clients
+bool openBank(const Config& cfg);
+
+// Function to stop the engine and journal and release the accounts set up by openBank()
+void closeBank();
+
+// ---------------------------------------------------------------------------
+// Engine internals the simulator's runners and reports read. bank_engine.cpp
+// owns all of this state; nothing here is meant to be written from outside
+// the engine except history.enabled, which is set before any client starts.
+// ---------------------------------------------------------------------------
+
+// Transaction history: per-thread arenas of Transaction records
+struct TransactionArena;
+
+struct TransactionHistory {
+    bool enabled;
+    pthread_mutex_t registryMutex;   // taken once per thread, never per record
+    std::vector<TransactionArena*> arenas;
+    uint64_t generation;             // bumped by clearHistory() so stale thread arenas are dropped
+};
+
+extern TransactionHistory history;
+
+// Function to resolve a TxnRef (valid once the writing thread has published it)
+const Transaction& getTransaction(TxnRef ref);
+
+// Function to report arena usage: records stored and bytes reserved for them
+void getHistoryUsage(uint64_t& records, uint64_t& bytes);
+
+// Function to release every arena (call after all threads have finished)
+void clearHistory();
+
+// Reconciliation: one pass over every balance
+struct Reconciliation {
+    Money total;
+    Money minBalance;
+    long long negativeCount;
+    const char* kernel;
+};
+
+// Function to reconcile every balance in the store (call when no transaction is in flight)
+Reconciliation reconcileBalances(const AccountStore& store);
+
+// Function to sum the lock-wait time of every account
+uint64_t totalLockWaitNanos();
+
+// Transaction journal
+// Compact binary journal record (48 bytes)
+struct JournalRecord {
+    uint64_t timestamp;      // wall clock, nanoseconds since the epoch
+    Money amount;
+    Money balanceAfter;      // balance of the (source) account after the operation
+    Money toBalanceAfter;    // transfers only
+    int32_t clientId;
+    int32_t accountIndex;
+    int32_t toAccountIndex;  // transfers only, -1 otherwise
+    uint8_t op;
+    uint8_t success;
+    uint8_t outcome;         // Outcome, tells why a failed operation failed
+    uint8_t reserved;
+};
+
+struct JournalRing;
+
+struct Journal {
+    bool enabled;
+    JournalFormat format;
+    JournalPolicy policy;
+    uint64_t ringCapacity;
+    FILE* out;
+    pthread_t writer;
+    std::atomic<bool> stopping;
+    pthread_mutex_t registryMutex;   // guards rings; taken once per thread, never per record
+    std::vector<JournalRing*> rings;
+    uint64_t written;
+    uint64_t batches;
+    Money deposited;                 // ledger of successful deposits seen by the writer
+    Money withdrawn;                 // ledger of successful withdrawals seen by the writer
+    uint64_t generation;             // bumped by stopJournal() so stale thread rings are dropped
+};
+
+extern Journal journal;
+
+// Function to start the journal writer; out must stay open until stopJournal()
+bool startJournal(FILE* out, JournalFormat format, JournalPolicy policy, uint64_t ringCapacity);
+
+// Function to stop the writer after all producers are done; returns dropped records
+uint64_t stopJournal();
+
+// Write-ahead log
+// Segment header, first page of the file
+struct WalHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t recordSize;
+    int64_t numAccounts;
+    Money initialBalance;
+    uint64_t capacity;          // records
+    uint64_t generation;        // bumped every time the segment is opened for appending
+};
+
+// Fixed-size log record (32 bytes)
+struct WalRecord {
+    std::atomic<uint64_t> sequence; // (generation << 48) | (slot + 1), written last; 0 = never written
+    Money amount;
+    int32_t accountIndex;
+    int32_t toAccountIndex;     // transfers only, -1 otherwise
+    uint8_t op;
+    uint8_t reserved[3];
+    uint32_t checksum;          // over every other field
+};
+
+struct Wal {
+    bool enabled;
+    bool sync;                  // clients wait for their group commit
+    int fd;
+    char* base;
+    size_t mappedBytes;
+    WalHeader* header;
+    WalRecord* records;
+    uint64_t capacity;
+    uint64_t reserve;           // new records this run asked room for
+    uint64_t generation;
+    uint64_t intervalNanos;     // commit at least this often
+    uint64_t batch;             // ...or as soon as this many records are pending (0 = interval only)
+    alignas(64) std::atomic<uint64_t> tail; // next slot to reserve
+    alignas(64) std::atomic<uint64_t> durable; // records covered by a completed msync
+    std::atomic<uint64_t> overflow;         // operations refused because the segment was full
+    std::atomic<bool> stopping;
+    pthread_t flusher;
+    uint64_t commits;
+    uint64_t commitNanos;       // time spent inside msync
+    uint64_t recovered;         // records replayed when the segment was opened
+    uint64_t recoveryNanos;
+};
+
+extern Wal wal;
+
+// Operations this thread has had refused because the segment was full; callers compare it
+// before and after an operation to tell a refusal from a lack of funds
+extern thread_local uint64_t threadWalRefusals;
+
+// Function to map an existing or new segment. A new writable segment is pre-allocated to capacity
+// records; an existing one is grown by startWal() to hold capacity records after the replayed ones.
+bool mapWal(const std::string& path, bool writable, uint64_t capacity);
+
+// Function to rebuild balances by replaying the longest valid prefix of the mapped segment.
+// The account store must already hold the opening balances; returns the records replayed.
+uint64_t replayWal();
+
+// Function to release the mapping
+void unmapWal();
+
+// Function to start appending to a segment mapped with mapWal(): existing records are
+// replayed into the (already initialized) account store first, new ones continue after them
+bool startWal(bool sync, double intervalMicros, uint64_t batch);
+
+// Function to wait until every record appended so far is durable (--wal-sync)
+void walWaitForCommit();
+
+// Function to stop the flusher after all producers are done (the final group commit runs first)
+void closeWal();
+
+// Online snapshots
+// Snapshot file header, followed by numAccounts balances
+struct SnapshotHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t reserved;
+    int64_t numAccounts;
+    uint64_t epoch;
+    uint64_t timestamp;         // wall clock at the end of the pass, nanoseconds since the epoch
+    Money total;
+};
+
+struct SnapshotState {
+    bool enabled;
+    alignas(64) std::atomic<uint64_t> epoch;
+    uint64_t* versions;         // epoch each account was last copied for (under its lock)
+    Money* shadow;              // balances as of the latest cut
+    std::atomic<uint64_t> copies; // copies made by writers rather than by the snapshot thread
+    pthread_mutex_t cutMutex;   // one cut at a time (periodic snapshots and the auditor share it)
+    bool periodic;              // the snapshot thread is running
+    std::string path;
+    uint64_t intervalNanos;
+    std::atomic<bool> stopping;
+    pthread_t thread;
+    // Written by the snapshot thread only
+    uint64_t taken;
+    uint64_t totalNanos;
+    uint64_t maxNanos;
+    uint64_t writeNanos;
+    uint64_t lockWaitNanos;     // client lock waits accumulated while passes were running
+    bool failed;
+};
+
+extern SnapshotState snapshots;
+
+// Function to start the periodic snapshot thread
+bool startSnapshots(const std::string& path, double intervalSeconds);
+
+// Function to stop the periodic thread once clients are done; a final snapshot records the end state
+void stopSnapshots();
+
+// Function to release snapshot state (after the report)
+void destroySnapshots();
+
+// Function to read a snapshot file's header; returns false if it is not a valid snapshot
+bool readSnapshotHeader(const std::string& path, SnapshotHeader& header);
+
+// Function to load every balance from a snapshot file into the (already sized) account store
+bool loadSnapshot(const std::string& path);
+
+// Invariant auditor
+struct AuditLedger;
+
+struct Auditor {
+    bool enabled;
+    uint64_t trailCapacity;              // entries per thread (power of two)
+    pthread_mutex_t registryMutex;       // guards ledgers; taken once per thread
+    std::vector<AuditLedger*> ledgers;
+    Money openingTotal;
+    Money drift;                         // difference already reported, so each violation is flagged once
+    uint64_t intervalNanos;
+    std::atomic<bool> stopping;
+    pthread_t thread;
+    // Written by the auditor thread only
+    Money* previous;                     // image at the previous audit
+    uint64_t previousEpoch;
+    uint64_t audits;
+    uint64_t totalNanos;
+    uint64_t maxNanos;
+    uint64_t violations;
+};
+
+extern Auditor audit;
+
+// Function to start the auditor; openingTotal is the sum of all balances before clients start
+bool startAuditor(double intervalSeconds, uint64_t trailCapacity, Money openingTotal);
+
+// Function to stop the auditor once clients are done; a final audit covers the tail of the run
+void stopAuditor();
+
+// Function to release the auditor's ledgers (after the report)
+void destroyAuditor();
+
+// Sharded engine
+struct Shard;
+
+struct ShardSet {
+    std::vector<Shard*> shards;
+    std::atomic<bool> running;
+    // Totals collected when the shards stop
+    uint64_t messages;
+    uint64_t forwarded;
+    Money inFlight;
+};
+
+extern ShardSet shardSet;
+
+// Optimistic engine: function to sum every thread's counters
+void getOccTotals(uint64_t& txns, uint64_t& aborts, uint64_t& retried);
+
+// Function to free every thread's optimistic-concurrency counters (the bank is closed)
+void clearOccStats();
+
+#endif
@@ -0,0 +1,157 @@
+// Microbenchmarks for the bank engine (Google Benchmark).
+//
+// Each benchmark opens a fresh bank before it runs and closes it afterwards, so
+// every (accounts, hot, engine, threads) combination starts from the same state.
+// "hot" is the number of accounts the threads pick from: 1 puts every thread on
+// the same account (or the same pair, for transfers), 0 spreads them over all
+// accounts.
+//
+//   ./bank_benchmark --benchmark_filter=Transfer --benchmark_out=run.json
+//   python3 benchmarks/compare.py baseline.json run.json
+
+#include <benchmark/benchmark.h>
+
+#include "bank_simulator.h"
+
+// Large enough that no withdrawal or transfer of one cent ever fails
+static const Money BENCH_BALANCE = 1000000000000LL;
+
+// Function to open the bank described by the benchmark arguments
+static void openBenchBank(const benchmark::State& state) {
+    Config cfg = defaultHeadlessConfig();
+    cfg.numAccounts = (int)state.range(0);
+    cfg.initialBalance = BENCH_BALANCE;
+    cfg.engine = (int)state.range(2);
+    cfg.recordHistory = false;
+    if (!openBank(cfg)) abort();
+}
+
+static void closeBenchBank(const benchmark::State&) {
+    closeBank();
+}
+
+// Per-thread account picker (xorshift, seeded from the thread index)
+struct BenchPicker {
+    uint64_t state;
+    uint64_t hot;
+
+    BenchPicker(const benchmark::State& s)
+        : state(0x9E3779B97F4A7C15ULL * (s.thread_index() + 1)),
+          hot(s.range(1) > 0 && s.range(1) < s.range(0) ? s.range(1) : s.range(0)) {}
+
+    int next() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return (int)(state % hot);
+    }
+};
+
+static void BM_Deposit(benchmark::State& state) {
+    BenchPicker picker(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(engine->deposit(state.thread_index(), picker.next(), 1));
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(engine->name);
+}
+
+static void BM_Withdraw(benchmark::State& state) {
+    BenchPicker picker(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(engine->withdraw(state.thread_index(), picker.next(), 1));
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(engine->name);
+}
+
+static void BM_Transfer(benchmark::State& state) {
+    BenchPicker picker(state);
+    int count = (int)state.range(0);
+    for (auto _ : state) {
+        int from = picker.next();
+        int to = picker.hot == 1 ? (from + 1) % count : picker.next();
+        if (to == from) to = (from + 1) % count;
+        benchmark::DoNotOptimize(engine->transfer(state.thread_index(), from, to, 1));
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(engine->name);
+}
+
+static void engineArgs(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"accounts", "hot", "engine"})
+     ->ArgsProduct({{1024, 1 << 20}, {1, 64, 0}, {ENGINE_MUTEX, ENGINE_ATOMIC, ENGINE_SHARDED, ENGINE_OPTIMISTIC}})
+     ->ThreadRange(1, 8)
+     ->UseRealTime()
+     ->Setup(openBenchBank)
+     ->Teardown(closeBenchBank);
+}
+
+BENCHMARK(BM_Deposit)->Apply(engineArgs);
+BENCHMARK(BM_Withdraw)->Apply(engineArgs);
+BENCHMARK(BM_Transfer)->Apply(engineArgs);
+
+// Read-mostly mix on the mutex engine under each lock policy: one deposit for every
+// 15 balance inquiries. range(2) is the LockPolicy.
+static void openLockBank(const benchmark::State& state) {
+    Config cfg = defaultHeadlessConfig();
+    cfg.numAccounts = (int)state.range(0);
+    cfg.initialBalance = BENCH_BALANCE;
+    cfg.engine = ENGINE_MUTEX;
+    cfg.lockPolicy = (int)state.range(2);
+    cfg.recordHistory = false;
+    if (!openBank(cfg)) abort();
+}
+
+static void BM_ReadMostly(benchmark::State& state) {
+    BenchPicker picker(state);
+    uint64_t n = 0;
+    for (auto _ : state) {
+        int accountIndex = picker.next();
+        if ((++n & 15) == 0) benchmark::DoNotOptimize(engine->deposit(state.thread_index(), accountIndex, 1));
+        else benchmark::DoNotOptimize(engine->balance(accountIndex));
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(LOCK_POLICY_NAMES[state.range(2)]);
+}
+
+BENCHMARK(BM_ReadMostly)
+    ->ArgNames({"accounts", "hot", "lock"})
+    ->ArgsProduct({{1024}, {1, 64, 0}, {LOCK_MUTEX, LOCK_SPIN, LOCK_ADAPTIVE, LOCK_SEQLOCK}})
+    ->ThreadRange(1, 8)
+    ->UseRealTime()
+    ->Setup(openLockBank)
+    ->Teardown(closeBenchBank);
+
+// logTransaction() on its own: every record goes through the journal ring (a binary
+// journal written to /dev/null), and range(0) = 1 also appends it to the account's
+// history. History arenas grow with every record until the bank is closed, so the
+// iteration count is fixed rather than left to the time-based estimate.
+static void openLogBank(const benchmark::State& state) {
+    Config cfg = defaultHeadlessConfig();
+    cfg.numAccounts = 1024;
+    cfg.engine = ENGINE_MUTEX;
+    cfg.recordHistory = state.range(0) != 0;
+    cfg.journalPath = "/dev/null";
+    cfg.journalFormat = JOURNAL_BINARY;
+    if (!openBank(cfg)) abort();
+}
+
+static void BM_LogTransaction(benchmark::State& state) {
+    int clientId = state.thread_index();
+    int accountIndex = clientId % accounts.count;
+    for (auto _ : state) {
+        logTransaction(clientId, OP_DEPOSIT, true, accountIndex, -1, 1, 0);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_LogTransaction)
+    ->ArgName("history")->Arg(0)->Arg(1)
+    ->ThreadRange(1, 8)
+    ->Iterations(1 << 20)
+    ->UseRealTime()
+    ->Setup(openLogBank)
+    ->Teardown(closeBenchBank);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+"""Compare two Google Benchmark JSON files and flag throughput regressions.
+
+    ./bank_benchmark --benchmark_out=baseline.json --benchmark_repetitions=5
+    ./bank_benchmark --benchmark_out=candidate.json --benchmark_repetitions=5
+    python3 benchmarks/compare.py baseline.json candidate.json --threshold 5
+
+Benchmarks are matched by name and compared on items_per_second (the mean when
+the runs were repeated). Exits with status 1 if any benchmark is slower than the
+baseline by more than the threshold (percent), so it can gate a CI job.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    """Return {benchmark name: items_per_second}, preferring mean aggregates."""
+    with open(path) as f:
+        data = json.load(f)
+    runs, means = {}, {}
+    for entry in data.get("benchmarks", []):
+        rate = entry.get("items_per_second")
+        if rate is None:
+            continue
+        name = entry.get("run_name", entry["name"])
+        if entry.get("run_type") == "aggregate":
+            if entry.get("aggregate_name") == "mean":
+                means[name] = rate
+        else:
+            runs.setdefault(name, []).append(rate)
+    result = {name: sum(rates) / len(rates) for name, rates in runs.items()}
+    result.update(means)
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("candidate")
+    parser.add_argument("--threshold", type=float, default=5.0,
+                        help="slowdown in percent that counts as a regression (default 5)")
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    candidate = load(args.candidate)
+
+    width = max([len(name) for name in baseline] + [9])
+    print(f"{'benchmark':<{width}}  {'baseline':>12}  {'candidate':>12}  {'change':>8}")
+    regressions = 0
+    for name in sorted(baseline):
+        if name not in candidate:
+            continue
+        before, after = baseline[name], candidate[name]
+        change = (after - before) / before * 100 if before > 0 else 0.0
+        mark = ""
+        if change < -args.threshold:
+            mark = "  REGRESSION"
+            regressions += 1
+        print(f"{name:<{width}}  {before:>12.4g}  {after:>12.4g}  {change:>+7.1f}%{mark}")
+
+    for name in sorted(set(baseline) - set(candidate)):
+        print(f"missing in candidate: {name}")
+    for name in sorted(set(candidate) - set(baseline)):
+        print(f"new in candidate: {name}")
+
+    print(f"regressions={regressions} threshold={args.threshold:g}%")
+    return 1 if regressions > 0 else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())